@@ -0,0 +1,138 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "RPMSerialInterface.h"
+#include "RPMLockFreeQueue.h"
+
+namespace RPM
+{
+
+/* 
+	AsyncSerialInterface
+
+	An asynchronous front end to a SerialInterface. A dedicated I/O thread owns the 
+	SerialInterface (and therefore the serial port) and drains a lock-free queue of 
+	encoded commands. The calling thread never waits on the serial port: the command 
+	methods return as soon as the command is queued, and the query methods return a 
+	future that is fulfilled once the I/O thread has read the response.
+
+	The I/O thread writes all the commands it finds in the queue with a single write,
+	then reads the responses of the queries in the order they were sent (the Maestro
+	answers in FIFO order).
+
+	The command methods can be called from any number of threads. They return false 
+	if the command is invalid or if the queue is full.
+*/
+class AsyncSerialInterface
+{
+public:
+	// The result of a query. On success, value holds the position, the moving state (0 or 1) 
+	// or the error flags depending on the query.
+	struct QueryResult
+	{
+		QueryResult() : success(false), value(0) {}
+		bool			success;
+		unsigned short	value;
+	};
+	typedef std::future<QueryResult> Future;
+
+	// Take the ownership of the SerialInterface and start the I/O thread.
+	// The SerialInterface must not be used directly anymore.
+	AsyncSerialInterface( SerialInterface* serialInterface, unsigned int queueCapacity=1024 );
+	
+	// Process the commands still in the queue, stop the I/O thread and delete the SerialInterface
+	~AsyncSerialInterface();
+
+	bool setTargetCP( unsigned char channelNumber, unsigned short target );
+	bool setTargetPP( unsigned char deviceNumber, unsigned char channelNumber, unsigned short target );
+	bool setSpeedCP( unsigned char channelNumber, unsigned short speed );
+	bool setSpeedPP( unsigned char deviceNumber, unsigned char channelNumber, unsigned short speed );
+	bool setAccelerationCP( unsigned char channelNumber, unsigned char acceleration );
+	bool setAccelerationPP( unsigned char deviceNumber, unsigned char channelNumber, unsigned char acceleration );
+	bool goHomeCP();
+	bool goHomePP( unsigned char deviceNumber );
+
+	// If the query can't be queued, the returned future is immediately ready with an unsuccessful result
+	Future getPositionCP( unsigned char channelNumber );
+	Future getPositionPP( unsigned char deviceNumber, unsigned char channelNumber );
+	Future getMovingStateCP();
+	Future getMovingStatePP( unsigned char deviceNumber );
+	Future getErrorsCP();
+	Future getErrorsPP( unsigned char deviceNumber );
+
+	// The number of commands and queries that couldn't be queued or failed on the I/O thread
+	unsigned int getNumFailures() const		{ return mNumFailures.load(); }
+
+private:
+	AsyncSerialInterface( const AsyncSerialInterface& );
+	AsyncSerialInterface& operator=( const AsyncSerialInterface& );
+
+	enum ResponseType
+	{
+		NoResponse,
+		PositionResponse,
+		MovingStateResponse,
+		ErrorsResponse
+	};
+
+	struct Command
+	{
+		unsigned char					bytes[Protocol::MaxFrameSize];
+		unsigned char					numBytes;
+		ResponseType					responseType;
+		std::promise<QueryResult>*		promise;
+	};
+
+	// The frames are encoded straight into the queue element
+	template <class ProtocolType, class CommandType>
+	bool pushCommand( unsigned char deviceNumber, unsigned char channelNumber=0, unsigned short value=0 );
+	template <class ProtocolType, class CommandType>
+	Future pushQuery( unsigned char deviceNumber, unsigned char channelNumber, ResponseType responseType );
+	bool pushCommand( Command& command );
+	Future pushQuery( Command& command );
+	void wakeUpIOThread();
+	void run();
+	void completeQuery( const Command& command, bool success, const unsigned char* response );
+	static unsigned int getResponseSize( ResponseType responseType );
+
+	SerialInterface*				mSerialInterface;
+	LockFreeQueue<Command>			mQueue;
+	std::vector<Command>			mPendingQueries;	// Only accessed by the I/O thread
+	std::atomic<bool>				mStopRequested;
+	std::atomic<bool>				mIOThreadWaiting;
+	std::atomic<unsigned int>		mNumFailures;
+	std::mutex						mWakeUpMutex;
+	std::condition_variable			mWakeUpCondition;
+	std::thread						mIOThread;
+};
+
+}
@@ -0,0 +1,127 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "RPMSerialInterface.h"
+#include "RPMShadowState.h"
+
+namespace RPM
+{
+
+/* 
+	FairMutex
+
+	A mutex granted in the order it was requested (a ticket lock), so a thread hammering 
+	the bus can't starve the others. Waiting threads sleep on a condition variable.
+	Can be used with std::lock_guard and std::unique_lock.
+*/
+class FairMutex
+{
+public:
+	FairMutex();
+	void lock();
+	void unlock();
+
+private:
+	FairMutex( const FairMutex& );
+	FairMutex& operator=( const FairMutex& );
+
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	unsigned long long int mNextTicket;
+	unsigned long long int mServedTicket;
+};
+
+/* 
+	BusManager
+
+	Coordinates several Maestro devices daisy-chained on one serial line, addressed with 
+	the Pololu protocol. The BusManager owns the SerialInterface of the line.
+
+	Each registered device gets a ShadowState: the targets, speeds and accelerations set 
+	by any thread are recorded there, and flush(), typically called once per tick, writes 
+	the values that changed on all the devices in a single write.
+	
+	All the accesses to the line (flush, queries, execute) are serialized by a FairMutex: 
+	the threads get the line in the order they asked for it, whatever device they query.
+*/
+class BusManager
+{
+public:
+	explicit BusManager( SerialInterface* serialInterface );
+	~BusManager();
+
+	// Register a device of the chain. Return false if the device number is invalid or already registered.
+	// The devices should be registered before the BusManager is shared between threads.
+	bool addDevice( unsigned char deviceNumber, unsigned char numChannels );
+	bool hasDevice( unsigned char deviceNumber ) const;
+	const std::vector<unsigned char>& getDeviceNumbers() const	{ return mDeviceNumbers; }
+	
+	// The ShadowState of a device, to configure it (deadbands, Set Multiple Targets...) before 
+	// the BusManager is shared between threads. NULL if the device isn't registered.
+	ShadowState* getShadowState( unsigned char deviceNumber ) const;
+
+	// Record a value for the next flush. Return false if the device isn't registered or the value is invalid.
+	bool setTarget( unsigned char deviceNumber, unsigned char channelNumber, unsigned short target );
+	bool setSpeed( unsigned char deviceNumber, unsigned char channelNumber, unsigned short speed );
+	bool setAcceleration( unsigned char deviceNumber, unsigned char channelNumber, unsigned char acceleration );
+
+	// Write the values that changed, on all the devices, in a single write.
+	// If the write fails, all the values are sent again on the next flush.
+	bool flush();
+
+	// Queries, each waiting for its turn on the line
+	bool getPosition( unsigned char deviceNumber, unsigned char channelNumber, unsigned short& position, unsigned int timeoutInMs=SerialInterface::DefaultReadTimeout );
+	bool getPositions( unsigned char deviceNumber, const unsigned char* channelNumbers, unsigned int numChannels, unsigned short* positions, unsigned int timeoutInMs=SerialInterface::DefaultReadTimeout );
+	bool getMovingState( unsigned char deviceNumber, bool& servosAreMoving, unsigned int timeoutInMs=SerialInterface::DefaultReadTimeout );
+	bool getErrors( unsigned char deviceNumber, unsigned short& errors, unsigned int timeoutInMs=SerialInterface::DefaultReadTimeout );
+
+	// Give a function exclusive access to the line, for anything not covered above. 
+	// If the function changes values tracked by the ShadowStates (a "go home" for example), 
+	// it should invalidate them.
+	bool execute( const std::function<bool( SerialInterface& serialInterface )>& function );
+
+	// The error of the last failed access to the line, formatted
+	std::string getErrorMessage();
+
+private:
+	BusManager( const BusManager& );
+	BusManager& operator=( const BusManager& );
+
+	static const unsigned int mMaxNumDevices = 128;		// The device number is a 7-bit data byte
+
+	SerialInterface* mSerialInterface;
+	FairMutex mBusMutex;			// Serializes the accesses to the line
+	std::mutex mStateMutex;			// Protects the ShadowStates
+	Error mLastError;				// Protected by mBusMutex
+	std::vector<ShadowState*> mShadowStates;	// Indexed by device number
+	std::vector<unsigned char> mDeviceNumbers;
+};
+
+}
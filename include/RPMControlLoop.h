@@ -0,0 +1,126 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "RPMSerialInterface.h"
+
+namespace RPM
+{
+
+class ShadowState;
+
+/* 
+	ControlLoop
+
+	Calls a tick function at a fixed rate, for example to stream the targets of a servo loop 
+	at 50 to 200 Hz. The ticks are scheduled on absolute deadlines of the monotonic clock 
+	(clock_nanosleep on Linux), so the time spent in the tick and in the commands doesn't 
+	make the period drift.
+
+	Each tick runs inside a batch of the SerialInterface: the commands it issues are written 
+	in one go when the tick returns. The calls made during the tick only queue the commands, 
+	so whether they reached the device is only known afterwards: a tick whose write failed is 
+	counted in getNumFailedTicks(), and isLastTickWritten() tells the next tick about it. 
+	The ShadowStates flushed by the tick should be added to the loop, which invalidates them 
+	when the write fails so their values are sent again on the next tick.
+
+	The loop records, for each tick, how late it woke up compared to its deadline (the jitter) 
+	in a histogram of power-of-two buckets, and counts the overruns: the ticks that ended after 
+	the next deadline. After an overrun, the deadlines missed are skipped rather than run back 
+	to back, and the tick index jumps accordingly, so tickIndex*period stays the time of the tick.
+*/
+class ControlLoop
+{
+public:
+	// The tick function returns false to stop the loop
+	typedef std::function<bool( unsigned long long int tickIndex )> TickFunction;
+
+	explicit ControlLoop( unsigned int periodInUs );
+
+	unsigned int getPeriodInUs() const	{ return mPeriodInUs; }
+
+	// Invalidate the ShadowState whenever the write of a tick fails. It isn't owned by the loop.
+	void addShadowState( ShadowState* shadowState )		{ mShadowStates.push_back( shadowState ); }
+
+	// Call tickFunction on every period, on the calling thread, until it returns false or stop() 
+	// is called. The statistics are reset at the beginning. The SerialInterface can be NULL.
+	void run( SerialInterface* serialInterface, const TickFunction& tickFunction );
+	
+	// Make run() return after the current tick. Can be called from any thread, or from the tick.
+	// A stop requested before run() makes it return right away.
+	void stop()		{ mStopRequested.store( true ); }
+
+	// Clear the stop request, so run() can be called again after a stop(). When run() is called 
+	// from another thread, call reset() before starting that thread, otherwise a stop() issued 
+	// meanwhile would be lost.
+	void reset()	{ mStopRequested.store( false ); }
+
+	// Real-time settings of the calling thread, to call before run(). Setting a SCHED_FIFO 
+	// priority usually requires privileges (CAP_SYS_NICE or an rtprio limit). 
+	// Return false and set the optional error message when not possible or not supported.
+	static bool setThreadRealTimePriority( int priority, std::string* errorMessage=NULL );
+	static bool setThreadCPUAffinity( unsigned int cpuIndex, std::string* errorMessage=NULL );
+
+	// Whether the commands of the previous tick were written. True when no tick has run yet, 
+	// or when there's no SerialInterface. The error is available from the SerialInterface.
+	bool isLastTickWritten() const	{ return mLastTickWritten; }
+
+	// Statistics of the last run. Bucket 0 counts the ticks woken up less than 1us late, 
+	// bucket i>0 the ticks woken up between 2^(i-1) and 2^i us late (the last bucket counts 
+	// everything later).
+	static const unsigned int NumJitterBuckets = 24;
+	unsigned long long int getNumTicks() const						{ return mNumTicks; }
+	unsigned long long int getNumOverruns() const					{ return mNumOverruns; }
+	unsigned long long int getNumFailedTicks() const				{ return mNumFailedTicks; }
+	unsigned long long int getNumTicksInJitterBucket( unsigned int bucket ) const	{ return mJitterHistogram[bucket]; }
+	unsigned long long int getMaxJitterInUs() const					{ return mMaxJitterInUs; }
+	
+	// Return the jitter (in us) below which the given percentage of the ticks woke up, 
+	// rounded up to the upper bound of its bucket (but not above the maximum jitter)
+	unsigned long long int getJitterPercentileInUs( double percentile ) const;
+
+private:
+	ControlLoop( const ControlLoop& );
+	ControlLoop& operator=( const ControlLoop& );
+
+	void resetStatistics();
+	void addJitter( long long int jitterInNs );
+
+	unsigned int mPeriodInUs;
+	std::vector<ShadowState*> mShadowStates;
+	std::atomic<bool> mStopRequested;
+	unsigned long long int mNumTicks;
+	unsigned long long int mNumOverruns;
+	unsigned long long int mNumFailedTicks;
+	bool mLastTickWritten;
+	unsigned long long int mMaxJitterInUs;
+	unsigned long long int mJitterHistogram[NumJitterBuckets];
+};
+
+}
@@ -0,0 +1,212 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <type_traits>
+
+#include "RPMProtocol.h"
+#include "RPMSerialInterface.h"
+
+namespace RPM
+{
+
+/* 
+	Device
+
+	A handle on a Maestro device whose protocol (and device number with the Pololu protocol) 
+	and transport type are fixed at compile time. ProtocolType is either CompactProtocol or 
+	PololuDeviceProtocol<DeviceNumber>:
+
+		RPM::TransportMemory transport( &simulator );
+		RPM::Device<RPM::Protocol::PololuDeviceProtocol<12>, RPM::TransportMemory> device( transport );
+		device.setTarget( 0, 6000 );
+
+	The commands are encoded into a buffer held by the Device and handed to the transport 
+	through a non-virtual call to TransportType::writeBytes, so with a concrete transport type 
+	a command inlines down to a few byte stores. TransportType must be a concrete Transport.
+
+	Between beginBatch() and endBatch(), the frames accumulate in the buffer of the Device and 
+	are written when it's full or when the batch ends. A query flushes the batch first.
+	Device doesn't go through a SerialInterface: the reason of a failure is the error of the 
+	transport, except for invalid arguments, which just return false, and for the responses 
+	the device sent but that aren't valid, reported as a ProtocolError by getResponseError().
+
+	The Mini-SSC protocol has no device number and a single command, so it has no protocol 
+	type of its own: setTargetMSSCP() is available whatever the protocol of the Device.
+*/
+template <class ProtocolType, class TransportType, unsigned int BufferSize=256>
+class Device
+{
+	// The device number of a Pololu protocol Device is part of its type
+	static_assert( !std::is_same<ProtocolType, Protocol::PololuProtocol>::value, "Use PololuDeviceProtocol<DeviceNumber> instead of PololuProtocol" );
+
+public:
+	explicit Device( TransportType& transport )
+		: mTransport(transport), mBatchDepth(0), mBufferSize(0), mReadTimeoutInMs(1000), mResponseError()
+	{
+	}
+
+	~Device()
+	{
+		flushBatch();
+	}
+
+	TransportType& getTransport()	{ return mTransport; }
+
+	void setReadTimeout( unsigned int timeoutInMs )		{ mReadTimeoutInMs = timeoutInMs; }
+	unsigned int getReadTimeout() const					{ return mReadTimeoutInMs; }
+
+	bool setTarget( unsigned char channelNumber, unsigned short target )
+	{
+		if ( target<SerialInterface::getMinChannelValue() || target>SerialInterface::getMaxChannelValue() )
+			return false;
+		return sendCommand<Protocol::SetTarget>( channelNumber, target );
+	}
+
+	bool setSpeed( unsigned char channelNumber, unsigned short speed )				{ return sendCommand<Protocol::SetSpeed>( channelNumber, speed ); }
+	bool setAcceleration( unsigned char channelNumber, unsigned char acceleration )	{ return sendCommand<Protocol::SetAcceleration>( channelNumber, acceleration ); }
+	bool goHome()																	{ return sendCommand<Protocol::GoHome>(); }
+
+	bool setTargetMSSCP( unsigned char miniSSCChannelNumber, unsigned char normalizedTarget )
+	{
+		if ( normalizedTarget>254 || !reserveFrame( Protocol::MiniSSCFrameSize ) )
+			return false;
+		mBufferSize += Protocol::encodeMiniSSCSetTarget( mBuffer + mBufferSize, miniSSCChannelNumber, normalizedTarget );
+		return isBatching() ? true : flushBatch();
+	}
+
+	// On Mini Maestro 12, 18 and 24 only. The frame must fit in the buffer of the Device.
+	bool setMultipleTargets( unsigned char firstChannelNumber, unsigned char numTargets, const unsigned short* targets )
+	{
+		if ( numTargets==0 || numTargets>Protocol::SetMultipleTargets::maxNumTargets || !targets )
+			return false;
+		for ( unsigned char i=0; i<numTargets; ++i )
+		{
+			if ( targets[i]<SerialInterface::getMinChannelValue() || targets[i]>SerialInterface::getMaxChannelValue() )
+				return false;
+		}
+		const unsigned int frameSize = Protocol::getSetMultipleTargetsFrameSize<ProtocolType>( numTargets );
+		if ( frameSize>BufferSize || !reserveFrame( frameSize ) )
+			return false;
+		mBufferSize += Protocol::encodeSetMultipleTargets<ProtocolType>( mBuffer + mBufferSize, 0, firstChannelNumber, numTargets, targets );
+		return isBatching() ? true : flushBatch();
+	}
+
+	bool getPosition( unsigned char channelNumber, unsigned short& position )
+	{
+		unsigned char response[Protocol::GetPosition::numResponseBytes];
+		position = 0;
+		if ( !sendQuery<Protocol::GetPosition>( channelNumber, response ) )
+			return false;
+		position = Protocol::decodePosition( response );
+		return true;
+	}
+
+	bool getMovingState( bool& servosAreMoving )
+	{
+		unsigned char response[Protocol::GetMovingState::numResponseBytes];
+		servosAreMoving = false;
+		if ( !sendQuery<Protocol::GetMovingState>( 0, response ) )
+			return false;
+		if ( !Protocol::decodeMovingState( response, servosAreMoving ) )
+		{
+			mResponseError.set( ProtocolError, 0, 0, 0, response[0] );
+			return false;
+		}
+		return true;
+	}
+
+	bool getErrors( unsigned short& errors )
+	{
+		unsigned char response[Protocol::GetErrors::numResponseBytes];
+		if ( !sendQuery<Protocol::GetErrors>( 0, response ) )
+			return false;
+		errors = Protocol::decodeErrors( response );
+		return true;
+	}
+
+	// The error of the last query whose response was received but invalid, cleared by every query
+	const Error& getResponseError() const	{ return mResponseError; }
+
+	// Batches can be nested, only the outermost endBatch() writes the buffer
+	void beginBatch()			{ mBatchDepth++; }
+	bool endBatch()
+	{
+		if ( mBatchDepth==0 )
+			return true;
+		mBatchDepth--;
+		return mBatchDepth>0 ? true : flushBatch();
+	}
+	bool isBatching() const		{ return mBatchDepth>0; }
+
+	bool flushBatch()
+	{
+		if ( mBufferSize==0 )
+			return true;
+		unsigned int size = mBufferSize;
+		mBufferSize = 0;
+		return mTransport.TransportType::writeBytes( mBuffer, size );
+	}
+
+	// Send any fixed-size command of RPMProtocol.h
+	template <class CommandType>
+	bool sendCommand( unsigned char channelNumber=0, unsigned short value=0 )
+	{
+		const unsigned int frameSize = Protocol::FrameSize<ProtocolType, CommandType>::value;
+		static_assert( frameSize<=BufferSize, "The buffer of the Device is too small" );
+		if ( !reserveFrame( frameSize ) )
+			return false;
+		Protocol::encode<ProtocolType, CommandType>( mBuffer + mBufferSize, 0, channelNumber, value );
+		mBufferSize += frameSize;
+		return isBatching() ? true : flushBatch();
+	}
+
+	template <class CommandType>
+	bool sendQuery( unsigned char channelNumber, unsigned char* response )
+	{
+		mResponseError.clear();
+		if ( !sendCommand<CommandType>( channelNumber ) || !flushBatch() )
+			return false;
+		return mTransport.TransportType::readBytes( response, CommandType::numResponseBytes, mReadTimeoutInMs );
+	}
+
+private:
+	Device( const Device& );
+	Device& operator=( const Device& );
+
+	// Make room for a frame in the buffer, writing what it holds when it's too full
+	bool reserveFrame( unsigned int frameSize )
+	{
+		return mBufferSize + frameSize <= BufferSize || flushBatch();
+	}
+
+	TransportType& mTransport;
+	unsigned int mBatchDepth;
+	unsigned int mBufferSize;
+	unsigned int mReadTimeoutInMs;
+	Error mResponseError;
+	unsigned char mBuffer[BufferSize];
+};
+
+}
@@ -0,0 +1,89 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <string>
+
+namespace RPM
+{
+
+// The reason why a method returned false
+enum ErrorCode
+{
+	NoError = 0,
+	InvalidArgumentError,		// A target out of range, too many targets, a NULL array...
+	PortClosedError,			// The port isn't open
+	WriteError,					// The system refused to write the bytes
+	ShortWriteError,			// Only some of the bytes have been written
+	ReadError,					// The system refused to read the bytes
+	ShortReadError,				// The port was closed before all the bytes could be read
+	TimeoutError,				// The bytes didn't arrive in time
+	ProtocolError,				// The device answered something that isn't a valid response
+	DeviceError					// The system reported an error on the device (setting its timeouts, waiting on it...)
+};
+
+/*
+	Error
+
+	Describes the last failure of a SerialInterface or a Transport.
+	Setting and clearing an Error only stores a few integers, it never allocates memory,
+	so the command path stays allocation-free even when it fails. The human-readable 
+	message is only formatted when getMessage() is called.
+*/
+class Error
+{
+public:
+	Error();
+
+	void clear()					{ set( NoError ); }
+	
+	// The meaning of value depends on the code: the offending value for InvalidArgumentError,
+	// the time budget in milliseconds for TimeoutError, unused otherwise.
+	// The system error code is errno on POSIX and GetLastError() on Windows.
+	void set( ErrorCode code, int systemErrorCode=0, unsigned int numBytesTransferred=0, unsigned int numBytesExpected=0, unsigned int value=0 );
+
+	ErrorCode getCode() const					{ return mCode; }
+	int getSystemErrorCode() const				{ return mSystemErrorCode; }
+	unsigned int getNumBytesTransferred() const	{ return mNumBytesTransferred; }
+	unsigned int getNumBytesExpected() const	{ return mNumBytesExpected; }
+	unsigned int getValue() const				{ return mValue; }
+	
+	bool isError() const			{ return mCode!=NoError; }
+	bool hasTimedOut() const		{ return mCode==TimeoutError; }
+
+	// Return the message describing the error, or an empty string if there's no error
+	std::string getMessage() const;
+
+	// Return the short name of an error code, for example "Timeout"
+	static const char* getCodeName( ErrorCode code );
+
+private:
+	ErrorCode mCode;
+	int mSystemErrorCode;
+	unsigned int mNumBytesTransferred;
+	unsigned int mNumBytesExpected;
+	unsigned int mValue;
+};
+
+}
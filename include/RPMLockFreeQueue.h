@@ -0,0 +1,143 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace RPM
+{
+
+/* 
+	LockFreeQueue
+
+	A bounded multi-producer/multi-consumer queue that never takes a lock.
+	Each cell carries a sequence number telling producers and consumers whether 
+	it's free or holds a value (see Dmitry Vyukov's bounded MPMC queue).
+	The capacity is rounded up to the next power of two.
+	push() and pop() return false instead of waiting when the queue is full or empty.
+*/
+template<typename T>
+class LockFreeQueue
+{
+public:
+	explicit LockFreeQueue( std::size_t capacity )
+		: mCells(NULL),
+		  mMask(0),
+		  mEnqueuePosition(0),
+		  mDequeuePosition(0)
+	{
+		std::size_t size = 2;
+		while ( size<capacity )
+			size *= 2;
+		mCells = new Cell[size];
+		mMask = size - 1;
+		for ( std::size_t i=0; i<size; ++i )
+			mCells[i].sequence.store( i, std::memory_order_relaxed );
+	}
+
+	~LockFreeQueue()
+	{
+		delete[] mCells;
+	}
+
+	std::size_t getCapacity() const		{ return mMask + 1; }
+
+	bool push( const T& value )
+	{
+		Cell* cell = NULL;
+		std::size_t position = mEnqueuePosition.load( std::memory_order_relaxed );
+		for ( ;; )
+		{
+			cell = &mCells[position & mMask];
+			std::size_t sequence = cell->sequence.load( std::memory_order_acquire );
+			std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+			if ( difference==0 )
+			{
+				if ( mEnqueuePosition.compare_exchange_weak( position, position+1, std::memory_order_relaxed ) )
+					break;
+			}
+			else if ( difference<0 )
+			{
+				return false;		// Full
+			}
+			else
+			{
+				position = mEnqueuePosition.load( std::memory_order_relaxed );
+			}
+		}
+		cell->data = value;
+		cell->sequence.store( position+1, std::memory_order_release );
+		return true;
+	}
+
+	bool pop( T& value )
+	{
+		Cell* cell = NULL;
+		std::size_t position = mDequeuePosition.load( std::memory_order_relaxed );
+		for ( ;; )
+		{
+			cell = &mCells[position & mMask];
+			std::size_t sequence = cell->sequence.load( std::memory_order_acquire );
+			std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position+1);
+			if ( difference==0 )
+			{
+				if ( mDequeuePosition.compare_exchange_weak( position, position+1, std::memory_order_relaxed ) )
+					break;
+			}
+			else if ( difference<0 )
+			{
+				return false;		// Empty
+			}
+			else
+			{
+				position = mDequeuePosition.load( std::memory_order_relaxed );
+			}
+		}
+		value = cell->data;
+		cell->sequence.store( position+mMask+1, std::memory_order_release );
+		return true;
+	}
+
+private:
+	LockFreeQueue( const LockFreeQueue& );
+	LockFreeQueue& operator=( const LockFreeQueue& );
+
+	struct Cell
+	{
+		std::atomic<std::size_t> sequence;
+		T data;
+	};
+
+	// The positions are kept on separate cache lines so producers and consumer don't contend
+	Cell* mCells;
+	std::size_t mMask;
+	char mPadding0[64];
+	std::atomic<std::size_t> mEnqueuePosition;
+	char mPadding1[64];
+	std::atomic<std::size_t> mDequeuePosition;
+	char mPadding2[64];
+};
+
+}
@@ -0,0 +1,154 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <vector>
+
+#include "RPMError.h"
+#include "RPMProtocol.h"
+#include "RPMTransportPOSIX.h"
+
+namespace RPM
+{
+
+/* 
+	MultiPortController
+
+	Drives many Maestros, each on its own serial port (typically one /dev/ttyACM* per USB 
+	Maestro), from a single thread. The commands and queries are queued per port, then 
+	transfer() writes all the ports at once and gathers the responses as they arrive, 
+	multiplexing the ports on one epoll loop (poll on Mac OS). The time of a transfer is 
+	therefore the time of the slowest port, not the sum of the round trips of all the ports.
+
+		RPM::MultiPortController controller;
+		unsigned int port0 = controller.addPort( new RPM::TransportPOSIX( "/dev/ttyACM0", 0 ) );
+		unsigned int port1 = controller.addPort( new RPM::TransportPOSIX( "/dev/ttyACM2", 0 ) );
+		controller.queueCommand<RPM::Protocol::CompactProtocol, RPM::Protocol::SetTarget>( port0, 0, 3, 6000 );
+		controller.queueQuery<RPM::Protocol::CompactProtocol, RPM::Protocol::GetPosition>( port1, 0, 3, &position );
+		controller.transfer( 100 );
+
+	The controller takes the ownership of the transports and switches their file descriptors 
+	to non-blocking mode: they must not be used directly anymore.
+	On POSIX platforms only.
+*/
+class MultiPortController
+{
+public:
+	MultiPortController();
+	~MultiPortController();
+
+	// Take the ownership of an open transport and return the index of its port
+	unsigned int addPort( TransportPOSIX* transport );
+	unsigned int getNumPorts() const	{ return static_cast<unsigned int>(mPorts.size()); }
+
+	// Queue a command for the next transfer. The value isn't checked.
+	template <class ProtocolType, class CommandType>
+	bool queueCommand( unsigned int portIndex, unsigned char deviceNumber, unsigned char channelNumber=0, unsigned short value=0 );
+
+	// Queue a query for the next transfer. Once the transfer has completed on the port, the decoded 
+	// response (a position, a moving state of 0 or 1, or error flags) is stored in result.
+	template <class ProtocolType, class CommandType>
+	bool queueQuery( unsigned int portIndex, unsigned char deviceNumber, unsigned char channelNumber, unsigned short* result );
+
+	// Write the commands queued on every port and read the responses of their queries, all the 
+	// ports at the same time. Return false if a port failed, didn't answer before the timeout or 
+	// answered an invalid moving state, its error is then available from getPortError. The queues are empty afterwards.
+	bool transfer( unsigned int timeoutInMs );
+
+	const Error& getPortError( unsigned int portIndex ) const	{ return mPorts[portIndex].error; }
+
+private:
+	MultiPortController( const MultiPortController& );
+	MultiPortController& operator=( const MultiPortController& );
+
+	enum QueryType
+	{
+		PositionQuery,
+		MovingStateQuery,
+		ErrorsQuery
+	};
+
+	struct Query
+	{
+		QueryType type;
+		unsigned short* result;
+	};
+
+	struct Port
+	{
+		Port();
+		TransportPOSIX* transport;
+		int fileDescriptor;
+		std::vector<unsigned char> output;
+		std::size_t numBytesWritten;
+		std::vector<unsigned char> input;
+		std::size_t numBytesRead;
+		std::vector<Query> queries;
+		unsigned int registeredEvents;		// The events the loop currently waits for on the port
+		bool discardInputBeforeWrite;		// After a timeout, a late response must not be taken for the next one
+		Error error;
+	};
+
+	template <class CommandType> static QueryType getQueryType();
+	bool isValidPort( unsigned int portIndex ) const;
+	unsigned int getWantedEvents( const Port& port ) const;
+	bool waitForEvents( int timeoutInMs );
+	void processEvents( Port& port, unsigned int events );
+	bool decodeResponses( Port& port );
+
+	std::vector<Port> mPorts;
+	int mEpollFileDescriptor;						// -1 when poll is used
+	std::vector<unsigned int> mReadyEvents;			// The events of each port, set by waitForEvents
+	std::vector<unsigned char> mEventBuffer;		// The raw epoll_event or pollfd array
+};
+
+template <> inline MultiPortController::QueryType MultiPortController::getQueryType<Protocol::GetPosition>()		{ return PositionQuery; }
+template <> inline MultiPortController::QueryType MultiPortController::getQueryType<Protocol::GetMovingState>()	{ return MovingStateQuery; }
+template <> inline MultiPortController::QueryType MultiPortController::getQueryType<Protocol::GetErrors>()		{ return ErrorsQuery; }
+
+template <class ProtocolType, class CommandType>
+bool MultiPortController::queueCommand( unsigned int portIndex, unsigned char deviceNumber, unsigned char channelNumber, unsigned short value )
+{
+	if ( !isValidPort(portIndex) )
+		return false;
+	std::vector<unsigned char>& output = mPorts[portIndex].output;
+	std::size_t offset = output.size();
+	output.resize( offset + Protocol::FrameSize<ProtocolType, CommandType>::value );
+	Protocol::encode<ProtocolType, CommandType>( &output[offset], deviceNumber, channelNumber, value );
+	return true;
+}
+
+template <class ProtocolType, class CommandType>
+bool MultiPortController::queueQuery( unsigned int portIndex, unsigned char deviceNumber, unsigned char channelNumber, unsigned short* result )
+{
+	if ( !result || !queueCommand<ProtocolType, CommandType>( portIndex, deviceNumber, channelNumber ) )
+		return false;
+	Query query;
+	query.type = getQueryType<CommandType>();
+	query.result = result;
+	mPorts[portIndex].queries.push_back( query );
+	return true;
+}
+
+}
@@ -0,0 +1,221 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+namespace RPM
+{
+
+/* 
+	Protocol
+
+	The layout of the frames of the Maestro serial protocol, defined once.
+	See http://www.pololu.com/docs/0J40/5.e for the details of the commands.
+
+	A command is described at compile time by its opcode, the number of data bytes following 
+	the opcode and the number of bytes of its response. A protocol (compact or Pololu) describes 
+	the header put in front of the data bytes. The encoders write a frame into a buffer supplied 
+	by the caller and return its size, which is also available at compile time (FrameSize), 
+	so the buffers can live on the stack, in a batch or in a queue without any temporary:
+
+		unsigned char frame[RPM::Protocol::FrameSize<RPM::Protocol::PololuProtocol, RPM::Protocol::SetTarget>::value];
+		unsigned int size = RPM::Protocol::encode<RPM::Protocol::PololuProtocol, RPM::Protocol::SetTarget>( frame, 12, 0, 6000 );
+*/
+namespace Protocol
+{
+
+template <unsigned char OpcodeValue, unsigned int NumDataBytesValue, unsigned int NumResponseBytesValue>
+struct CommandDescriptor
+{
+	static const unsigned char opcode = OpcodeValue;
+	static const unsigned int numDataBytes = NumDataBytesValue;		// 0, 1 (the channel) or 3 (the channel and a 14-bit value)
+	static const unsigned int numResponseBytes = NumResponseBytesValue;
+};
+
+typedef CommandDescriptor<0x84, 3, 0> SetTarget;
+typedef CommandDescriptor<0x87, 3, 0> SetSpeed;
+typedef CommandDescriptor<0x89, 3, 0> SetAcceleration;
+typedef CommandDescriptor<0x90, 1, 2> GetPosition;
+typedef CommandDescriptor<0x93, 0, 1> GetMovingState;
+typedef CommandDescriptor<0xA1, 0, 2> GetErrors;
+typedef CommandDescriptor<0xA2, 0, 0> GoHome;
+
+// Set Multiple Targets has a variable size: the count, the first channel, then 2 bytes per target
+struct SetMultipleTargets
+{
+	static const unsigned char opcode = 0x9F;
+	static const unsigned int maxNumTargets = 127;		// The count is sent as a 7-bit data byte
+};
+
+// The first byte of a Pololu protocol frame, and on its own, the baud rate indication byte
+static const unsigned char PololuStartByte = 0xAA;
+static const unsigned char MiniSSCStartByte = 0xFF;
+
+struct CompactProtocol
+{
+	static const unsigned int headerSize = 1;
+
+	template <class CommandType>
+	static unsigned char* writeHeader( unsigned char* buffer, unsigned char /*deviceNumber*/ )
+	{
+		*buffer++ = CommandType::opcode;
+		return buffer;
+	}
+};
+
+struct PololuProtocol
+{
+	static const unsigned int headerSize = 3;
+
+	template <class CommandType>
+	static unsigned char* writeHeader( unsigned char* buffer, unsigned char deviceNumber )
+	{
+		*buffer++ = PololuStartByte;
+		*buffer++ = deviceNumber;
+		*buffer++ = CommandType::opcode & 0x7F;
+		return buffer;
+	}
+};
+
+// The Pololu protocol addressed to a device number fixed at compile time (see Device).
+// The device number given to the encoders is ignored.
+template <unsigned char DeviceNumberValue>
+struct PololuDeviceProtocol
+{
+	static const unsigned int headerSize = PololuProtocol::headerSize;
+	static const unsigned char deviceNumber = DeviceNumberValue;
+
+	template <class CommandType>
+	static unsigned char* writeHeader( unsigned char* buffer, unsigned char /*deviceNumber*/ )
+	{
+		return PololuProtocol::writeHeader<CommandType>( buffer, DeviceNumberValue );
+	}
+};
+
+template <class ProtocolType, class CommandType>
+struct FrameSize
+{
+	static const unsigned int value = ProtocolType::headerSize + CommandType::numDataBytes;
+};
+
+// The size of the largest fixed-size frame (a Pololu protocol Set Target), and of the largest response
+static const unsigned int MaxFrameSize = FrameSize<PololuProtocol, SetTarget>::value;
+static const unsigned int MaxResponseSize = 2;
+
+// The size of a Set Multiple Targets frame
+template <class ProtocolType>
+inline unsigned int getSetMultipleTargetsFrameSize( unsigned int numTargets )
+{
+	return ProtocolType::headerSize + 2 + 2*numTargets;
+}
+
+// Write a frame of a fixed-size command and return its size. The channel number and the value 
+// are ignored by the commands that don't have them, the device number by the compact protocol.
+template <class ProtocolType, class CommandType>
+inline unsigned int encode( unsigned char* buffer, unsigned char deviceNumber, unsigned char channelNumber=0, unsigned short value=0 )
+{
+	static_assert( CommandType::numDataBytes==0 || CommandType::numDataBytes==1 || CommandType::numDataBytes==3, "Not a fixed-size command" );
+	unsigned char* data = ProtocolType::template writeHeader<CommandType>( buffer, deviceNumber );
+	if ( CommandType::numDataBytes>=1 )
+		data[0] = channelNumber;
+	if ( CommandType::numDataBytes>=3 )
+	{
+		data[1] = static_cast<unsigned char>( value & 0x7F );
+		data[2] = static_cast<unsigned char>( (value >> 7) & 0x7F );
+	}
+	return FrameSize<ProtocolType, CommandType>::value;
+}
+
+// Write a Set Multiple Targets frame and return its size. The buffer must hold 
+// getSetMultipleTargetsFrameSize<ProtocolType>(numTargets) bytes.
+template <class ProtocolType>
+inline unsigned int encodeSetMultipleTargets( unsigned char* buffer, unsigned char deviceNumber, unsigned char firstChannelNumber, unsigned char numTargets, const unsigned short* targets )
+{
+	unsigned char* data = ProtocolType::template writeHeader<SetMultipleTargets>( buffer, deviceNumber );
+	*data++ = numTargets;
+	*data++ = firstChannelNumber;
+	for ( unsigned char i=0; i<numTargets; ++i )
+	{
+		*data++ = static_cast<unsigned char>( targets[i] & 0x7F );
+		*data++ = static_cast<unsigned char>( (targets[i] >> 7) & 0x7F );
+	}
+	return getSetMultipleTargetsFrameSize<ProtocolType>( numTargets );
+}
+
+// The Mini-SSC protocol only has a Set Target command, on 3 bytes
+static const unsigned int MiniSSCFrameSize = 3;
+inline unsigned int encodeMiniSSCSetTarget( unsigned char* buffer, unsigned char miniSSCChannelNumber, unsigned char normalizedTarget )
+{
+	buffer[0] = MiniSSCStartByte;
+	buffer[1] = miniSSCChannelNumber;
+	buffer[2] = normalizedTarget;
+	return MiniSSCFrameSize;
+}
+
+// Decode the responses
+inline unsigned short decodePosition( const unsigned char* response )
+{
+	return static_cast<unsigned short>( response[0] + 256*response[1] );
+}
+
+inline unsigned short decodeErrors( const unsigned char* response )
+{
+	return static_cast<unsigned short>( (response[0] & 0x7F) + 256*(response[1] & 0x7F) );
+}
+
+// Return false if the response isn't a valid moving state
+inline bool decodeMovingState( const unsigned char* response, bool& servosAreMoving )
+{
+	servosAreMoving = ( response[0]==0x01 );
+	return response[0]==0x00 || response[0]==0x01;
+}
+
+// A frame encoded once, whose value can be changed in place, for the commands sent over and over
+template <class ProtocolType, class CommandType>
+class Frame
+{
+public:
+	static const unsigned int size = FrameSize<ProtocolType, CommandType>::value;
+
+	Frame( unsigned char deviceNumber, unsigned char channelNumber=0, unsigned short value=0 )
+	{
+		encode<ProtocolType, CommandType>( mBytes, deviceNumber, channelNumber, value );
+	}
+
+	void setValue( unsigned short value )
+	{
+		static_assert( CommandType::numDataBytes==3, "The command has no value" );
+		mBytes[size-2] = static_cast<unsigned char>( value & 0x7F );
+		mBytes[size-1] = static_cast<unsigned char>( (value >> 7) & 0x7F );
+	}
+
+	const unsigned char* getBytes() const	{ return mBytes; }
+	unsigned int getSize() const			{ return size; }
+
+private:
+	unsigned char mBytes[size];
+};
+
+}
+
+}
@@ -0,0 +1,174 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RPMError.h"
+
+namespace RPM
+{
+
+/* 
+	Recorder
+
+	Records the bytes a SerialInterface writes to and reads from its Transport, to find out 
+	afterwards what was sent to a misbehaving servo. Enable it with SerialInterface::setRecorder().
+
+	The recording goes to a file preallocated at its maximum size and mapped in memory: recording 
+	is a copy into the mapping, the kernel writes the pages back to the disk on its own, so the 
+	I/O calls never wait on the disk. Each write is split into its command frames, and each frame 
+	becomes one fixed-size Record, timestamped, with its opcode, channel and value decoded. Each 
+	read becomes one Record. A frame longer than a record (a large Set Multiple Targets) is 
+	continued on the following records.
+
+	The files are named <basePath>.000000, <basePath>.000001, etc... When a file is full, the 
+	recording goes on in the next one, and only the last maxNumFiles full files are kept besides 
+	the current one. A thread of the recorder prepares the next file in advance and closes the 
+	full ones, so switching files is just a swap of pointers. If the next file isn't ready (the 
+	disk is full, for example), the records are dropped and counted rather than waited for.
+	A recorder is used by one SerialInterface at a time. On POSIX platforms only: elsewhere, 
+	open() fails.
+*/
+class Recorder
+{
+public:
+	enum RecordType
+	{
+		EmptyRecord = 0,		// The end of the records in a file
+		WriteRecord = 1,
+		ReadRecord = 2
+	};
+
+	enum RecordFlags
+	{
+		ContinuedFlag = 0x01,	// The frame goes on in the next record
+		FailedFlag = 0x02		// The I/O call failed, see errorCode
+	};
+
+	static const unsigned int RecordSize = 64;
+	static const unsigned int MaxNumBytesPerRecord = 36;
+
+	struct Record
+	{
+		unsigned long long int timestampInNs;		// Monotonic clock, at the beginning of the I/O call
+		unsigned int callIndex;						// The number of the I/O call, shared by all its records
+		unsigned int callSizeInBytes;				// The number of bytes of the whole I/O call
+		unsigned char type;							// RecordType
+		unsigned char flags;						// RecordFlags
+		unsigned char errorCode;					// The ErrorCode of the I/O call
+		unsigned char numBytes;						// The number of bytes of the frame in this record
+		unsigned char opcode;						// The command, in compact protocol form (0x84 for Set Target...), 0 if unknown
+		unsigned char deviceNumber;					// For the Pololu protocol, 0xFF otherwise
+		unsigned char channelNumber;				// The channel (the first one for Set Multiple Targets), 0xFF if none
+		unsigned char padding;
+		unsigned short value;						// The target, speed or acceleration, or the position or errors read
+		unsigned short padding2;
+		unsigned char bytes[MaxNumBytesPerRecord];
+	};
+
+	// The first RecordSize bytes of a file
+	struct FileHeader
+	{
+		char magic[8];								// "RPMREC1"
+		unsigned int recordSize;
+		unsigned int numRecords;					// The capacity of the file, not the number of records used
+		unsigned int fileIndex;
+		unsigned int padding;
+		unsigned long long int wallClockTimeInNs;	// Time since the epoch when the file was created...
+		unsigned long long int timestampInNs;		// ...and the monotonic clock at that time
+		unsigned char reserved[24];
+	};
+
+	Recorder();
+	~Recorder();
+
+	// Start recording to new files. Existing files with the same names are overwritten.
+	// Return false and set the optional error message if the first file couldn't be created.
+	bool open( const std::string& basePath, unsigned int maxFileSizeInBytes=16*1024*1024, unsigned int maxNumFiles=4, std::string* errorMessage=NULL );
+	void close();
+	bool isOpen() const		{ return mCurrentFile.mapping!=NULL; }
+
+	// Called by the SerialInterface around its I/O calls. The timestamp is taken before the call.
+	static unsigned long long int getTimestampInNs();
+	void recordWrite( unsigned long long int timestampInNs, const unsigned char* data, unsigned int dataSizeInBytes, ErrorCode errorCode );
+	void recordRead( unsigned long long int timestampInNs, const unsigned char* data, unsigned int dataSizeInBytes, ErrorCode errorCode );
+
+	unsigned long long int getNumRecords() const			{ return mNumRecords; }
+	unsigned long long int getNumDroppedRecords() const		{ return mNumDroppedRecords; }		// When the next file wasn't ready
+	unsigned int getFileIndex() const						{ return mCurrentFile.fileIndex; }
+
+	static std::string getFilePath( const std::string& basePath, unsigned int fileIndex );
+
+	// Read the records of a file, up to the first empty one
+	static bool readFile( const std::string& filePath, FileHeader& header, std::vector<Record>& records, std::string* errorMessage=NULL );
+
+	// The size of the frame at the beginning of the data, as far as it can be known from its 
+	// first bytes. The whole data if the command is unknown.
+	static unsigned int getFrameSize( const unsigned char* data, unsigned int dataSizeInBytes );
+
+private:
+	Recorder( const Recorder& );
+	Recorder& operator=( const Recorder& );
+
+	struct MappedFile
+	{
+		MappedFile();
+		int fileDescriptor;
+		unsigned char* mapping;
+		unsigned int fileIndex;
+		unsigned int numRecordsUsed;
+	};
+
+	Record* getNextRecord();
+	bool switchToNextFile();
+	bool mapFile( unsigned int fileIndex, MappedFile& file, std::string* errorMessage ) const;
+	void unmapFile( MappedFile& file ) const;
+	void runFileThread();
+	static void decodeFrame( Record& record );
+
+	std::string mBasePath;
+	unsigned int mMaxNumFiles;
+	unsigned int mNumRecordsPerFile;
+	MappedFile mCurrentFile;
+	unsigned int mNumCalls;
+	unsigned long long int mNumRecords;
+	unsigned long long int mNumDroppedRecords;
+
+	// Shared with the file thread
+	std::mutex mFileMutex;
+	std::condition_variable mFileCondition;
+	MappedFile mNextFile;				// Ready to record into, once its mapping is set
+	MappedFile mFullFile;				// Waiting to be closed by the file thread
+	unsigned int mNextFileIndex;
+	bool mNextFileFailed;				// Not retried until the current file is full
+	bool mStopRequested;
+	std::thread mFileThread;
+};
+
+}
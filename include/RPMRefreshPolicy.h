@@ -0,0 +1,112 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "RPMSerialInterface.h"
+
+namespace RPM
+{
+
+/* 
+	RefreshPolicy
+
+	Decides when the positions of the channels of a device are worth reading, for the pollers 
+	that display or log them. Each refresh first sends the one-byte Get Moving State query, and 
+	only reads the positions when it's needed:
+	- while servos are moving, and once more when they stop, so the final positions are seen
+	- after forceRefresh(), which the application calls after writing to the device
+	- when the positions have never been read, or the last refresh failed
+
+	The refreshes are due at the minimum interval while something happens. While the servos 
+	are idle, the interval doubles after each refresh, up to the maximum interval. Most of the 
+	time the device holds a pose, and the polling then costs almost nothing on the serial line.
+
+	The Maestro only reports servos as moving when they are limited by a speed or an 
+	acceleration: a target reached instantly is only seen thanks to forceRefresh().
+
+	The application calls refresh() whenever isRefreshDue() returns true, typically from a 
+	timer ticking at the minimum interval or faster. forceRefresh() can be called from any 
+	thread, the rest from the thread using the SerialInterface only.
+*/
+class RefreshPolicy
+{
+public:
+	// The channels 0 to numChannels-1 are read. The queries use the Pololu protocol with the given 
+	// device number when usePololuProtocol is true, the compact protocol otherwise. 
+	// The RefreshPolicy doesn't own the SerialInterface.
+	RefreshPolicy( SerialInterface* serialInterface, unsigned char numChannels, bool usePololuProtocol=false, unsigned char deviceNumber=12 );
+
+	// The interval between the refreshes while servos are moving, and the longest one while they are idle
+	void setIntervals( unsigned int minIntervalInMs, unsigned int maxIntervalInMs );
+	unsigned int getMinIntervalInMs() const		{ return mMinIntervalInMs; }
+	unsigned int getMaxIntervalInMs() const		{ return mMaxIntervalInMs; }
+
+	// The interval currently applied, between the minimum and the maximum
+	unsigned int getIntervalInMs() const		{ return mIntervalInMs; }
+
+	// Make the next refresh due right away, and read the positions whether servos move or not
+	void forceRefresh()							{ mRefreshForced = true; }
+
+	bool isRefreshDue() const;
+
+	// Query the moving state, then read the positions if needed. positionsRead tells whether the 
+	// positions have been read, they are then available from getPositions(). Return false if a 
+	// query failed, the error is available from the SerialInterface.
+	bool refresh( bool& positionsRead, unsigned int timeoutInMs=SerialInterface::DefaultReadTimeout );
+
+	unsigned char getNumChannels() const						{ return static_cast<unsigned char>(mChannelNumbers.size()); }
+	const std::vector<unsigned short>& getPositions() const		{ return mPositions; }
+	bool getServosAreMoving() const								{ return mServosAreMoving; }
+
+	// The number of refreshes, and of refreshes that read the positions
+	unsigned long long int getNumRefreshes() const			{ return mNumRefreshes; }
+	unsigned long long int getNumPositionReads() const		{ return mNumPositionReads; }
+
+private:
+	RefreshPolicy( const RefreshPolicy& );
+	RefreshPolicy& operator=( const RefreshPolicy& );
+
+	static long long int getTimeInMicroseconds();
+	void scheduleNextRefresh( bool somethingHappened );
+
+	SerialInterface* mSerialInterface;
+	bool mUsePololuProtocol;
+	unsigned char mDeviceNumber;
+	std::vector<unsigned char> mChannelNumbers;
+	std::vector<unsigned short> mPositions;
+	unsigned int mMinIntervalInMs;
+	unsigned int mMaxIntervalInMs;
+	unsigned int mIntervalInMs;
+	long long int mNextRefreshTimeInUs;
+	std::atomic<bool> mRefreshForced;
+	bool mPositionsValid;
+	bool mServosAreMoving;
+	unsigned long long int mNumRefreshes;
+	unsigned long long int mNumPositionReads;
+};
+
+}
@@ -0,0 +1,123 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "RPMRecorder.h"
+#include "RPMSerialInterface.h"
+
+namespace RPM
+{
+
+/* 
+	Replayer
+
+	Sends again, through a SerialInterface, the bytes recorded by a Recorder, to reproduce 
+	what a process sent to the devices, or to load a device (or a simulator) with a realistic 
+	stream of commands.
+
+	The writes are issued as they were recorded: the frames of a batch are written in one go. 
+	They're scheduled at their recorded time (OriginalTiming), at the recorded time divided by 
+	a speed factor (ScaledTiming), or back to back (FastestTiming). The recorded reads are 
+	replayed as reads of the same size, and the responses compared with the recorded ones. 
+	The reads that failed at recording time are replayed too, so whatever the target answers 
+	to them is consumed, but their response isn't compared and their failure isn't counted.
+
+	The report gives the drift of the writes: how late each one was issued compared to its 
+	schedule.
+
+		RPM::Replayer replayer;
+		replayer.loadFile( RPM::Recorder::getFilePath( "servos.rec", 0 ) );
+		RPM::Replayer::Report report;
+		replayer.replay( serialInterface, RPM::Replayer::OriginalTiming, 1.0, &report );
+*/
+class Replayer
+{
+public:
+	enum TimingMode
+	{
+		OriginalTiming,
+		ScaledTiming,
+		FastestTiming
+	};
+
+	struct Report
+	{
+		Report();
+		unsigned long long int numWrites;
+		unsigned long long int numReads;
+		unsigned long long int numBytesWritten;
+		unsigned long long int numBytesRead;
+		unsigned long long int numFailures;					// The writes and reads that failed
+		unsigned long long int numMismatchedResponses;		// The reads whose bytes differ from the recording
+		unsigned long long int recordedDurationInUs;		// From the first to the last call, as recorded...
+		unsigned long long int durationInUs;				// ...and as replayed
+		unsigned long long int meanDriftInUs;
+		unsigned long long int p99DriftInUs;
+		unsigned long long int maxDriftInUs;
+	};
+
+	Replayer();
+
+	// Append the calls recorded in a file. The files of a recording are loaded in order.
+	bool loadFile( const std::string& filePath, std::string* errorMessage=NULL );
+	void clear();
+
+	unsigned int getNumCalls() const				{ return static_cast<unsigned int>(mCalls.size()); }
+	unsigned long long int getRecordedDurationInUs() const;
+
+	// Replay the calls loaded, on the calling thread. The speed is only used by ScaledTiming 
+	// (2.0 replays twice as fast). Return false if a call failed or the replay was stopped, 
+	// the report is filled in any case.
+	bool replay( SerialInterface* serialInterface, TimingMode timingMode, double speed=1.0, Report* report=NULL, unsigned int timeoutInMs=SerialInterface::DefaultReadTimeout );
+
+	// Make replay() return after the current call, from any thread
+	void stop()		{ mStopRequested.store( true ); }
+
+private:
+	Replayer( const Replayer& );
+	Replayer& operator=( const Replayer& );
+
+	struct Call
+	{
+		unsigned long long int timestampInNs;
+		unsigned int callIndex;
+		bool isWrite;
+		bool failed;					// A read that failed at recording time
+		std::size_t offset;				// In mBytes
+		unsigned int numBytes;			// The bytes written, or the bytes of the response recorded
+		unsigned int callSizeInBytes;	// The size of the original I/O call
+	};
+
+	std::vector<Call> mCalls;
+	std::vector<unsigned char> mBytes;
+	std::vector<long long int> mDrifts;
+	std::vector<unsigned char> mResponse;
+	std::atomic<bool> mStopRequested;
+};
+
+}
@@ -0,0 +1,133 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace RPM
+{
+
+/* 
+	SeqLockRing
+
+	A bounded ring of values written by a single producer and read by any number of consumers, 
+	without any lock on either side. The producer never waits: once the ring is full, each push 
+	overwrites the oldest value. Each value is numbered by the order of its push, so a consumer 
+	can read the latest one or walk the history from the index it last saw.
+
+	Each slot carries a sequence number, odd while the producer writes it (a seqlock): readers 
+	copy the value, then check the sequence number didn't change during the copy, and report 
+	the value as lost when it was overwritten in between.
+	T must be trivially copyable. The capacity is rounded up to the next power of two.
+*/
+template<typename T>
+class SeqLockRing
+{
+public:
+	explicit SeqLockRing( std::size_t capacity )
+		: mSlots(NULL),
+		  mMask(0),
+		  mNumPushed(0)
+	{
+		std::size_t size = 2;
+		while ( size<capacity )
+			size *= 2;
+		mSlots = new Slot[size];
+		mMask = size - 1;
+		for ( std::size_t i=0; i<size; ++i )
+			mSlots[i].sequence.store( 0, std::memory_order_relaxed );
+	}
+
+	~SeqLockRing()
+	{
+		delete[] mSlots;
+	}
+
+	std::size_t getCapacity() const						{ return mMask + 1; }
+
+	// The number of values pushed so far, which is also the index of the next one
+	unsigned long long int getNumPushed() const			{ return mNumPushed.load( std::memory_order_acquire ); }
+
+	// Producer only
+	void push( const T& value )
+	{
+		unsigned long long int index = mNumPushed.load( std::memory_order_relaxed );
+		Slot& slot = mSlots[index & mMask];
+		slot.sequence.store( 2*index+1, std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_release );
+		slot.data = value;
+		slot.sequence.store( 2*index+2, std::memory_order_release );
+		mNumPushed.store( index+1, std::memory_order_release );
+	}
+
+	// Copy the value of the given index. Return false if it wasn't pushed yet or was overwritten.
+	bool read( unsigned long long int index, T& value ) const
+	{
+		const Slot& slot = mSlots[index & mMask];
+		const unsigned long long int expectedSequence = 2*index+2;
+		for ( ;; )
+		{
+			unsigned long long int sequence = slot.sequence.load( std::memory_order_acquire );
+			if ( sequence==expectedSequence-1 )
+				continue;			// Being written, for a few nanoseconds
+			if ( sequence!=expectedSequence )
+				return false;
+			value = slot.data;
+			std::atomic_thread_fence( std::memory_order_acquire );
+			return slot.sequence.load( std::memory_order_relaxed )==expectedSequence;
+		}
+	}
+
+	// Copy the latest value. Return false if nothing was pushed yet.
+	bool readLatest( T& value ) const
+	{
+		for ( ;; )
+		{
+			unsigned long long int numPushed = getNumPushed();
+			if ( numPushed==0 )
+				return false;
+			if ( read( numPushed-1, value ) )
+				return true;
+		}
+	}
+
+private:
+	SeqLockRing( const SeqLockRing& );
+	SeqLockRing& operator=( const SeqLockRing& );
+
+	struct Slot
+	{
+		std::atomic<unsigned long long int> sequence;
+		T data;
+	};
+
+	Slot* mSlots;
+	std::size_t mMask;
+	char mPadding0[64];
+	std::atomic<unsigned long long int> mNumPushed;
+	char mPadding1[64];
+};
+
+}
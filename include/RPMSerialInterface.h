@@ -24,10 +24,18 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <map>
+
+#include "RPMTransport.h"
+#include "RPMProtocol.h"
+#include "RPMStatistics.h"
 
 namespace RPM
 {
 
+class Recorder;
+
 /* 
 	SerialInterface
 
@@ -41,6 +49,9 @@ namespace RPM
 	- Mini-SSC protocol (MSSCP)
 	See http://www.pololu.com/docs/0J40/5.c for more information.
 
+	The bytes go through a Transport, which can be a serial port or an in-memory 
+	buffer (see TransportMemory).
+
 	Note: add the ability to specify min/max target value at construction time rather 
 	than having it hard-coded.
 */
@@ -51,15 +62,41 @@ public:
 	// Return NULL if the interface couldn't be created and set the optional error message.
 	static SerialInterface* createSerialInterface( const std::string& portName, unsigned int baudRate, std::string* errorMessage=NULL );
 
-	// Return the last error message. The message is set when a methods encounters a problem and returns false.
-	// It is automatically cleared at the beginning of each method.
-	const std::string& getErrorMessage() const	{ return mErrorMessage; }
+	// Create a SerialInterface on top of the given Transport, which the SerialInterface takes the ownership of
+	explicit SerialInterface( Transport* transport );
+
+	// Return the last error. The error is set when a methods encounters a problem and returns false.
+	// It is automatically cleared at the beginning of each method. Setting or clearing the error 
+	// doesn't allocate memory, the message is only formatted when getErrorMessage() is called.
+	const Error& getError() const			{ return mError; }
+	ErrorCode getErrorCode() const			{ return mError.getCode(); }
+	std::string getErrorMessage() const		{ return mError.getMessage(); }
 
 	// Destructor
 	virtual ~SerialInterface();
+
+	// The queries (getPositionCP, getErrorsPP, etc...) take an optional time budget in milliseconds for 
+	// the response to arrive. When it's not given, the interface's read timeout is used (1000ms by default).
+	// When the response doesn't arrive in time, the query returns false and the error code is TimeoutError.
+	static const unsigned int DefaultReadTimeout = 0xFFFFFFFF;
+	void			setReadTimeout( unsigned int timeoutInMs )	{ mReadTimeoutInMs = timeoutInMs; }
+	unsigned int	getReadTimeout() const						{ return mReadTimeoutInMs; }
+	bool			hasTimedOut() const							{ return mError.hasTimedOut(); }
+
+	// The counters and latency histograms of the traffic (see Statistics). The snapshot can be 
+	// taken from any thread, the reset must be done from the thread using the interface.
+	void getStatistics( Statistics::Snapshot& snapshot ) const	{ mStatistics.getSnapshot( snapshot ); }
+	void resetStatistics()										{ mStatistics.reset(); }
+
+	// Record every byte written to and read from the transport (see Recorder). 
+	// The interface doesn't own the recorder. NULL stops recording.
+	void		setRecorder( Recorder* recorder )	{ mRecorder = recorder; }
+	Recorder*	getRecorder() const					{ return mRecorder; }
 			
 	// Indicates whether the serial port has been successfully open at construction
-	virtual bool isOpen() const = 0;
+	bool isOpen() const		{ return mTransport && mTransport->isOpen(); }
+
+	Transport* getTransport() const		{ return mTransport; }
 
 	// Return the minimum valid channel value in 0.25 microsecond units 
 	static unsigned short getMinChannelValue()  { return mMinChannelValue; }
@@ -79,8 +116,19 @@ public:
 	// Additionally, the miniSCC channel number allows access to channels of chained devices.
 	bool setTargetMSSCP( unsigned char miniSCCChannelNumber, unsigned char normalizedTarget );
 
-	// On Mini Maestro 12, 18 and 24 only, so not supported here (as I only have a Mini Maestro 6)
-	// bool setMultipleTargets(...) 
+	// Set the targets of numTargets contiguous channels, starting at firstChannelNumber, in a single command.
+	// The frame is 3+2*numTargets bytes long (plus 2 for the Pololu protocol) instead of 4*numTargets.
+	// On Mini Maestro 12, 18 and 24 only.
+	bool setMultipleTargetsCP( unsigned char firstChannelNumber, unsigned char numTargets, const unsigned short* targets );
+	bool setMultipleTargetsPP( unsigned char deviceNumber, unsigned char firstChannelNumber, unsigned char numTargets, const unsigned short* targets );
+
+	// Set the targets of an arbitrary set of channels (channel number -> target).
+	// The channels are split into the fewest runs of contiguous channels, each run being sent with 
+	// a single Set Multiple Targets command (a run of a single channel uses the shorter Set Target command).
+	// All the commands are written to the port at once. No command is sent if one of the targets is invalid.
+	// On Mini Maestro 12, 18 and 24 only.
+	bool setTargetsCP( const std::map<unsigned char, unsigned short>& targets );
+	bool setTargetsPP( unsigned char deviceNumber, const std::map<unsigned char, unsigned short>& targets );
 
 	// Set the speed limit of a channel in units of (0.25 microsecond)/(10ms)
 	bool setSpeedCP( unsigned char channelNumber, unsigned short speed );
@@ -94,16 +142,21 @@ public:
 	// For a servo channel, the position is the current pulse width in 0.25 microsecond units
 	// For a digital output channel, a position less than 6000 means the line is low, and high when above 6000
 	// For an input channel, the position represents the voltage measured on the channel. 
-	bool getPositionCP( unsigned char channelNumber, unsigned short& position );
-	bool getPositionPP( unsigned char deviceNumber, unsigned char channelNumber, unsigned short& position );
+	bool getPositionCP( unsigned char channelNumber, unsigned short& position, unsigned int timeoutInMs=DefaultReadTimeout );
+	bool getPositionPP( unsigned char deviceNumber, unsigned char channelNumber, unsigned short& position, unsigned int timeoutInMs=DefaultReadTimeout );
+
+	// Return the positions of several channels in a single round trip: all the requests are written 
+	// at once, then all the responses are read at once. The positions array must hold numChannels values.
+	bool getPositionsCP( const unsigned char* channelNumbers, unsigned int numChannels, unsigned short* positions, unsigned int timeoutInMs=DefaultReadTimeout );
+	bool getPositionsPP( unsigned char deviceNumber, const unsigned char* channelNumbers, unsigned int numChannels, unsigned short* positions, unsigned int timeoutInMs=DefaultReadTimeout );
 
 	// Indicate whether the servo outputs have reached their targets or are still moving.
-	bool getMovingStateCP( bool& servosAreMoving );
-	bool getMovingStatePP( unsigned char deviceNumber, bool& servosAreMoving );
+	bool getMovingStateCP( bool& servosAreMoving, unsigned int timeoutInMs=DefaultReadTimeout );
+	bool getMovingStatePP( unsigned char deviceNumber, bool& servosAreMoving, unsigned int timeoutInMs=DefaultReadTimeout );
 
 	// The return the error detected by the Pololu Maestro. This automatically clears the error flag.
-	bool getErrorsCP( unsigned short& error);
-	bool getErrorsPP( unsigned char deviceNumber, unsigned short& error );
+	bool getErrorsCP( unsigned short& error, unsigned int timeoutInMs=DefaultReadTimeout );
+	bool getErrorsPP( unsigned char deviceNumber, unsigned short& error, unsigned int timeoutInMs=DefaultReadTimeout );
 
 	// Request the Pololu Maestro to "go home".
 	// Going home sets the channels to their startup/error state.
@@ -113,23 +166,107 @@ public:
 	// - off: the channel is turned off. There's no more PWM signal generated for the channel
 	bool goHomeCP();
 	bool goHomePP( unsigned char deviceNumber );
+
+	// When its serial mode is "UART, detect baud rate", the Maestro measures the baud rate of the 
+	// TTL serial port on the first 0xAA byte it receives. Call this method once, right after creating 
+	// the interface and before any other command. It's harmless in the other modes.
+	bool sendBaudRateIndication();
+
+	// Batch mode. Between beginBatch() and endBatch(), the commands are not written to the 
+	// serial port immediately: they're encoded into a single buffer which is written in one go 
+	// when the batch ends. This saves one system call (and one USB transfer) per command.
+	// Batches can be nested, only the outermost endBatch() writes the buffer.
+	// Methods that expect a response from the device (getPositionCP, getErrorsPP, etc...) 
+	// automatically flush the pending commands before sending their request.
+	void beginBatch();
+	bool endBatch();
+	bool flushBatch();			// Write the pending commands now but stay in batch mode
+	bool isBatching() const						{ return mBatchDepth>0; }
+	unsigned int getBatchSizeInBytes() const	{ return static_cast<unsigned int>(mBatchBuffer.size()); }
+
+	// Send a command described in RPMProtocol.h, for example:
+	//   serialInterface->sendCommand<RPM::Protocol::PololuProtocol, RPM::Protocol::SetSpeed>( 12, channelNumber, speed );
+	// When batching, the frame is encoded straight into the batch buffer. The value isn't checked.
+	template <class ProtocolType, class CommandType>
+	bool sendCommand( unsigned char deviceNumber, unsigned char channelNumber=0, unsigned short value=0 );
+
+	// Send a query described in RPMProtocol.h and read its raw response (CommandType::numResponseBytes bytes)
+	template <class ProtocolType, class CommandType>
+	bool sendQuery( unsigned char deviceNumber, unsigned char channelNumber, unsigned char* response, unsigned int timeoutInMs=DefaultReadTimeout );
+
+	// Send frames encoded beforehand, they go through the batch like the other commands
+	bool sendFrame( const unsigned char* frame, unsigned int frameSizeInBytes );
+	template <class ProtocolType, class CommandType>
+	bool sendFrame( const Protocol::Frame<ProtocolType, CommandType>& frame )	{ return sendFrame( frame.getBytes(), frame.getSize() ); }
 		
 protected:
-	SerialInterface();
-	void clearErrorMessage();
-	void setErrorMessage( const std::string& message );
+	void clearError()		{ mError.clear(); }
+	void setError( ErrorCode code, unsigned int value=0 )	{ mError.set( code, 0, 0, 0, value ); mStatistics.addFailure( code ); }
 	
 	bool checkPortIsOpen() const;                             // And update error message if not
-	bool checkValidTargetValue(unsigned short target) const;  // Same here
+	bool checkValidTargetValue(unsigned short target);        // Same here
 
 private:
+	friend class AsyncSerialInterface;		// Its I/O thread writes pre-encoded commands and reads the responses
+	friend class Replayer;					// Writes and reads exactly what was recorded
+
 	static const unsigned short mMinChannelValue = 3968;
 	static const unsigned short mMaxChannelValue = 8000;
 	
-	virtual bool writeBytes( const unsigned char* data, unsigned int dataSizeInBytes ) = 0;
-	virtual bool readBytes( unsigned char* data, unsigned int dataSizeInBytes ) = 0;
+	SerialInterface( const SerialInterface& );
+	SerialInterface& operator=( const SerialInterface& );
+
+	bool writeBytes( const unsigned char* data, unsigned int dataSizeInBytes );
+	bool readBytes( unsigned char* data, unsigned int dataSizeInBytes, unsigned int timeoutInMs );
+
+	bool setMultipleTargets( bool usePololuProtocol, unsigned char deviceNumber, unsigned char firstChannelNumber, unsigned char numTargets, const unsigned short* targets );
+	bool setTargets( bool usePololuProtocol, unsigned char deviceNumber, const std::map<unsigned char, unsigned short>& targets );
+	bool getPositions( bool usePololuProtocol, unsigned char deviceNumber, const unsigned char* channelNumbers, unsigned int numChannels, unsigned short* positions, unsigned int timeoutInMs );
 
-	std::string mErrorMessage;
+	// Route the bytes to the batch buffer or to the port depending on the batch mode
+	bool sendBytes( const unsigned char* data, unsigned int dataSizeInBytes );
+	bool receiveBytes( unsigned char* data, unsigned int dataSizeInBytes, unsigned int timeoutInMs );
+
+	Transport* mTransport;
+	Recorder* mRecorder;
+	Error mError;
+	Statistics mStatistics;
+	long long int mLastWriteTimeInNs;			// When the last write started, for the round trips of the queries
+	unsigned int mReadTimeoutInMs;
+	unsigned int mBatchDepth;
+	std::vector<unsigned char> mBatchBuffer;
+	std::vector<unsigned char> mResponseBuffer;
 };
 
+template <class ProtocolType, class CommandType>
+bool SerialInterface::sendCommand( unsigned char deviceNumber, unsigned char channelNumber, unsigned short value )
+{
+	const unsigned int frameSize = Protocol::FrameSize<ProtocolType, CommandType>::value;
+	mStatistics.addCommand( CommandType::opcode );
+	if ( !isBatching() )
+	{
+		unsigned char frame[frameSize];
+		Protocol::encode<ProtocolType, CommandType>( frame, deviceNumber, channelNumber, value );
+		return writeBytes( frame, frameSize );
+	}
+
+	if ( !isOpen() )
+	{
+		setError( PortClosedError );
+		return false;
+	}
+	std::size_t offset = mBatchBuffer.size();
+	mBatchBuffer.resize( offset + frameSize );
+	Protocol::encode<ProtocolType, CommandType>( &mBatchBuffer[offset], deviceNumber, channelNumber, value );
+	return true;
+}
+
+template <class ProtocolType, class CommandType>
+bool SerialInterface::sendQuery( unsigned char deviceNumber, unsigned char channelNumber, unsigned char* response, unsigned int timeoutInMs )
+{
+	if ( !sendCommand<ProtocolType, CommandType>( deviceNumber, channelNumber ) )
+		return false;
+	return receiveBytes( response, CommandType::numResponseBytes, timeoutInMs );
+}
+
 }
\ No newline at end of file
@@ -0,0 +1,141 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <vector>
+
+#include "RPMSerialInterface.h"
+
+namespace RPM
+{
+
+/* 
+	ShadowState
+
+	Keeps, for each channel of a device, the target, speed and acceleration last sent to it.
+	The application sets the values it wants as often as it likes (typically the full pose 
+	on each tick), the ShadowState only marks as dirty the values that differ from what the 
+	device already has. flush() then sends the dirty values, and only them, in a single write.
+	
+	The ShadowState assumes it's the only one setting these values on the device. If something 
+	else changes them (a "go home", another program, a reset of the device...), call invalidate() 
+	so every value is sent again on the next flush.
+
+	With setUseMultipleTargets(true), the dirty targets of contiguous channels are sent with 
+	a single Set Multiple Targets command. On Mini Maestro 12, 18 and 24 only.
+
+	A target can also be given a deadband, for targets streamed from a controller whose jitter 
+	makes no visible difference to the servo. A new target within the deadband of the target 
+	last sent is held back. It's only sent once the hold time has passed since the target was 
+	last sent, so the servo still ends up at the exact latest value.
+*/
+class ShadowState
+{
+public:
+	// The commands use the Pololu protocol with the given device number when usePololuProtocol 
+	// is true, the compact protocol otherwise. The ShadowState doesn't own the SerialInterface.
+	ShadowState( SerialInterface* serialInterface, unsigned char numChannels, bool usePololuProtocol=false, unsigned char deviceNumber=12 );
+
+	unsigned char getNumChannels() const	{ return static_cast<unsigned char>(mChannels.size()); }
+
+	void setUseMultipleTargets( bool useMultipleTargets )	{ mUseMultipleTargets = useMultipleTargets; }
+	bool getUseMultipleTargets() const						{ return mUseMultipleTargets; }
+
+	// Set the value wanted for a channel. Nothing is sent until flush() is called.
+	// Return false if the channel number or the value is invalid.
+	bool setTarget( unsigned char channelNumber, unsigned short target );
+	bool setSpeed( unsigned char channelNumber, unsigned short speed );
+	bool setAcceleration( unsigned char channelNumber, unsigned char acceleration );
+
+	// Set the deadband in 0.25 microsecond units and the hold time in milliseconds of the target 
+	// of a channel, or of all the channels. A deadband of 0 (the default) disables the filtering.
+	bool setTargetDeadband( unsigned char channelNumber, unsigned short deadband, unsigned int holdTimeInMs );
+	void setTargetDeadband( unsigned short deadband, unsigned int holdTimeInMs );
+
+	// Return the value wanted for a channel, sent or not yet
+	unsigned short getTarget( unsigned char channelNumber ) const			{ return mChannels[channelNumber].target; }
+	unsigned short getSpeed( unsigned char channelNumber ) const			{ return mChannels[channelNumber].speed; }
+	unsigned char getAcceleration( unsigned char channelNumber ) const		{ return mChannels[channelNumber].acceleration; }
+
+	// Send the dirty values in a single write. When the write fails, the values stay dirty 
+	// and the error is available from the SerialInterface.
+	// Inside an outer batch of the SerialInterface, the values are only queued and marked as 
+	// sent: the owner of the batch must call invalidate() when its endBatch() fails. ControlLoop 
+	// does it for the ShadowStates added to it, BusManager for its own.
+	bool flush();
+	bool isDirty() const;
+
+	// Forget what has been sent: all the values that have been set are sent again on the next flush
+	void invalidate();
+
+	// The number of commands sent by flush(), and the number of commands saved: the calls to 
+	// setTarget(), setSpeed() and setAcceleration() with the value the device already had
+	unsigned long long int getNumCommandsSent() const			{ return mNumCommandsSent; }
+	unsigned long long int getNumCommandsSuppressed() const		{ return mNumCommandsSuppressed; }
+
+private:
+	enum Flags
+	{
+		TargetDirty = 0x01,
+		SpeedDirty = 0x02,
+		AccelerationDirty = 0x04,
+		TargetHeld = 0x08,			// The target is within the deadband of sentTarget but different
+		TargetSent = 0x10,			// The device has the value in sentTarget
+		SpeedSent = 0x20,
+		AccelerationSent = 0x40
+	};
+	
+	struct Channel
+	{
+		Channel();
+		unsigned short target;
+		unsigned short sentTarget;
+		unsigned short speed;
+		unsigned short sentSpeed;
+		unsigned char acceleration;
+		unsigned char sentAcceleration;
+		unsigned char flags;
+		unsigned short deadband;
+		unsigned int holdTimeInMs;
+		long long int targetSentTimeInUs;
+	};
+
+	ShadowState( const ShadowState& );
+	ShadowState& operator=( const ShadowState& );
+
+	static long long int getTimeInMicroseconds();
+	bool sendTargets();
+	bool sendTarget( unsigned char channelNumber );
+	
+	SerialInterface* mSerialInterface;
+	bool mUsePololuProtocol;
+	unsigned char mDeviceNumber;
+	bool mUseMultipleTargets;
+	std::vector<Channel> mChannels;
+	std::vector<unsigned short> mRunTargets;
+	unsigned long long int mNumCommandsSent;
+	unsigned long long int mNumCommandsSuppressed;
+};
+
+}
@@ -0,0 +1,129 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <vector>
+
+namespace RPM
+{
+
+/* 
+	Simulator
+
+	A software model of a Pololu Maestro, used to exercise the library without hardware.
+	It parses the bytes sent by the host exactly as the device would (Compact, Pololu and 
+	Mini-SSC protocols, see http://www.pololu.com/docs/0J40/5.c), produces the responses 
+	to the queries, and models the channel outputs:
+	- the speed and acceleration limits ramp the position towards the target
+	- the moving state is reported while a channel hasn't reached its target
+	- protocol errors set the error register, which is cleared when read
+
+	The Simulator has no notion of time on its own: update() advances it, 
+	and it doesn't deal with the transport (see the RapaPololuMaestroSimulator sample for a 
+	pseudo-terminal front end).
+*/
+class Simulator
+{
+public:
+	// Error flags, as returned by the Get Errors command
+	enum ErrorFlags
+	{
+		SerialSignalError = 0x0001,
+		SerialOverrunError = 0x0002,
+		SerialBufferFullError = 0x0004,
+		SerialCRCError = 0x0008,
+		SerialProtocolError = 0x0010,
+		SerialTimeoutError = 0x0020
+	};
+
+	Simulator( unsigned char numChannels=24, unsigned char deviceNumber=12 );
+
+	// Process the bytes received from the host. The responses to the queries are appended to response.
+	void processBytes( const unsigned char* data, unsigned int dataSizeInBytes, std::vector<unsigned char>& response );
+
+	// Advance the simulated time, moving the channels towards their targets
+	void update( unsigned int elapsedTimeInMicroseconds );
+
+	unsigned char	getNumChannels() const		{ return static_cast<unsigned char>(mChannels.size()); }
+	unsigned char	getDeviceNumber() const		{ return mDeviceNumber; }
+	
+	// The Mini-SSC channel number of channel 0. It allows several devices to be chained.
+	void			setMiniSSCOffset( unsigned char offset )	{ mMiniSSCOffset = offset; }
+	unsigned char	getMiniSSCOffset() const					{ return mMiniSSCOffset; }
+
+	// The Mini-SSC normalized targets (0 to 254) are mapped to neutral +/- range, in 0.25 microsecond units
+	void			setMiniSSCNeutralAndRange( unsigned short neutral, unsigned short range )	{ mMiniSSCNeutral = neutral; mMiniSSCRange = range; }
+
+	unsigned short	getTarget( unsigned char channelNumber ) const;
+	unsigned short	getPosition( unsigned char channelNumber ) const;
+	unsigned short	getSpeed( unsigned char channelNumber ) const;
+	unsigned char	getAcceleration( unsigned char channelNumber ) const;
+	bool			isMoving() const;
+	unsigned short	getErrors() const		{ return mErrors; }
+
+	// The number of complete commands addressed to this device since construction
+	unsigned int	getNumCommandsProcessed() const		{ return mNumCommandsProcessed; }
+
+private:
+	struct Channel
+	{
+		Channel() : target(0), position(0.f), velocity(0.f), speed(0), acceleration(0) {}
+		unsigned short	target;			// 0 means the output is off
+		float			position;
+		float			velocity;		// In (0.25 microsecond)/(10ms)
+		unsigned short	speed;
+		unsigned char	acceleration;
+	};
+
+	unsigned int	getNumDataBytes( unsigned char command ) const;
+	void			executeCommand( std::vector<unsigned char>& response );
+	void			setTarget( unsigned char channelNumber, unsigned short target );
+	void			stepChannel( Channel& channel );
+
+	std::vector<Channel>		mChannels;
+	unsigned char				mDeviceNumber;
+	unsigned char				mMiniSSCOffset;
+	unsigned short				mMiniSSCNeutral;
+	unsigned short				mMiniSSCRange;
+	unsigned short				mErrors;
+	unsigned int				mNumCommandsProcessed;
+	unsigned int				mTimeRemainderInMicroseconds;
+	
+	// Parser state
+	enum ParserState
+	{
+		WaitingForCommand,
+		WaitingForDeviceNumber,
+		WaitingForPololuCommand,
+		WaitingForData,
+		WaitingForMiniSSCData
+	};
+	ParserState					mParserState;
+	bool						mIsForThisDevice;
+	unsigned char				mCommand;
+	std::vector<unsigned char>	mData;
+	unsigned int				mNumDataBytesExpected;
+};
+
+}
@@ -0,0 +1,131 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <atomic>
+
+#include "RPMError.h"
+
+namespace RPM
+{
+
+/* 
+	Statistics
+
+	Counts what a SerialInterface sends and receives, always on: the commands per opcode, the 
+	writes and reads with their bytes, the failures per error code, and the latencies of the 
+	writes and of the round trips of the queries (from the write of the request to the end of 
+	the read of the response) in histograms of power-of-two buckets.
+
+	The counters are atomics updated with relaxed loads and stores, without read-modify-write 
+	instructions: they're written by the thread using the interface only (the interface isn't 
+	thread-safe anyway), and any other thread can take a snapshot at any time without stopping 
+	the traffic. A snapshot isn't atomic as a whole, the counters are read one after the other.
+*/
+class Statistics
+{
+public:
+	// The opcodes 0x80 to 0xFF, in compact protocol form. The Mini-SSC frames are counted as 0xFF.
+	static const unsigned int NumOpcodes = 128;
+	static const unsigned int NumErrorCodes = DeviceError + 1;
+
+	// Bucket 0 counts the durations under 1us, bucket i>0 the durations between 2^(i-1) and 
+	// 2^i us (the last bucket counts everything longer)
+	static const unsigned int NumLatencyBuckets = 24;
+
+	struct Snapshot
+	{
+		unsigned long long int numCommands[NumOpcodes];
+		unsigned long long int numWrites;
+		unsigned long long int numReads;
+		unsigned long long int numBytesWritten;
+		unsigned long long int numBytesRead;
+		unsigned long long int numFailures[NumErrorCodes];		// numFailures[NoError] is always 0
+		unsigned long long int writeLatencyHistogram[NumLatencyBuckets];
+		unsigned long long int roundTripHistogram[NumLatencyBuckets];
+
+		unsigned long long int getNumCommands( unsigned char opcode ) const		{ return numCommands[opcode & 0x7F]; }
+		unsigned long long int getTotalNumCommands() const;
+		unsigned long long int getTotalNumFailures() const;
+
+		// Return the duration (in us) below which the given percentage of a histogram falls, 
+		// rounded up to the upper bound of its bucket
+		static unsigned long long int getPercentileInUs( const unsigned long long int* histogram, double percentile );
+	};
+
+	Statistics();
+
+	// Updates, from the thread using the interface
+	void addCommand( unsigned char opcode )		{ increment( mNumCommands[opcode & 0x7F] ); }
+	void addFrame( const unsigned char* frame, unsigned int frameSizeInBytes );
+	void addWrite( unsigned int numBytes, long long int durationInNs )
+	{
+		increment( mNumWrites );
+		increment( mNumBytesWritten, numBytes );
+		increment( mWriteLatencyHistogram[getBucket(durationInNs)] );
+	}
+	void addRead( unsigned int numBytes )			{ increment( mNumReads ); increment( mNumBytesRead, numBytes ); }
+	void addRoundTrip( long long int durationInNs )	{ increment( mRoundTripHistogram[getBucket(durationInNs)] ); }
+	void addFailure( ErrorCode code )				{ if ( code!=NoError ) increment( mNumFailures[code] ); }
+
+	// From any thread
+	void getSnapshot( Snapshot& snapshot ) const;
+
+	// From the thread using the interface
+	void reset();
+
+private:
+	Statistics( const Statistics& );
+	Statistics& operator=( const Statistics& );
+
+	typedef std::atomic<unsigned long long int> Counter;
+
+	static void increment( Counter& counter, unsigned long long int value=1 )
+	{
+		counter.store( counter.load( std::memory_order_relaxed ) + value, std::memory_order_relaxed );
+	}
+
+	static unsigned int getBucket( long long int durationInNs )
+	{
+		unsigned long long int durationInUs = durationInNs>0 ? static_cast<unsigned long long int>(durationInNs / 1000) : 0;
+		unsigned int bucket = 0;
+		while ( durationInUs>0 && bucket<NumLatencyBuckets-1 )
+		{
+			durationInUs >>= 1;
+			bucket++;
+		}
+		return bucket;
+	}
+
+	Counter mNumCommands[NumOpcodes];
+	Counter mNumWrites;
+	Counter mNumReads;
+	Counter mNumBytesWritten;
+	Counter mNumBytesRead;
+	Counter mNumFailures[NumErrorCodes];
+	Counter mWriteLatencyHistogram[NumLatencyBuckets];
+	Counter mRoundTripHistogram[NumLatencyBuckets];
+};
+
+}
@@ -0,0 +1,92 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <atomic>
+
+#include "RPMSerialInterface.h"
+
+namespace RPM
+{
+
+/* 
+	TargetCoalescer
+
+	Keeps only the latest target of each channel between two writes, for targets edited far 
+	more often than they need to be sent (a slider dragged in a user interface, a joystick...).
+	Any thread sets the targets, as often as it likes, without waiting on the serial port. 
+	The thread using the SerialInterface calls flush() at a bounded rate, typically once per 
+	display frame, which sends the latest target of every channel edited since the previous 
+	flush, all the channels in a single write. 
+	
+	A channel dragged continuously then costs one command per flush, whatever the rate of 
+	its edits, and can't starve the other channels.
+*/
+class TargetCoalescer
+{
+public:
+	static const unsigned int MaxNumChannels = 24;
+
+	// The commands use the Pololu protocol with the given device number when usePololuProtocol 
+	// is true, the compact protocol otherwise. The TargetCoalescer doesn't own the SerialInterface.
+	TargetCoalescer( SerialInterface* serialInterface, unsigned char numChannels, bool usePololuProtocol=false, unsigned char deviceNumber=12 );
+
+	unsigned char getNumChannels() const	{ return mNumChannels; }
+
+	// Replace the target pending for a channel, from any thread. Nothing is sent until flush() 
+	// is called. Return false if the channel number or the target is invalid.
+	bool setTarget( unsigned char channelNumber, unsigned short target );
+
+	bool hasPendingTargets() const;
+
+	// Drop the pending targets, from any thread, for example before a command that moves the 
+	// servos on its own (Go Home) and that the pending targets would otherwise undo
+	void clear();
+
+	// Send the pending targets in a single write. When the write fails, the targets that haven't 
+	// been set again meanwhile are pending again, and the error is available from the SerialInterface.
+	bool flush();
+
+	// The number of targets set, and of targets actually sent. The difference is the number of 
+	// targets replaced by a later one before being sent.
+	unsigned long long int getNumTargetsSet() const		{ return mNumTargetsSet.load(std::memory_order_relaxed); }
+	unsigned long long int getNumTargetsSent() const	{ return mNumTargetsSent.load(std::memory_order_relaxed); }
+
+private:
+	TargetCoalescer( const TargetCoalescer& );
+	TargetCoalescer& operator=( const TargetCoalescer& );
+
+	// A pending target is stored with this flag, so 0 means nothing is pending
+	static const unsigned int PendingFlag = 0x10000;
+
+	SerialInterface* mSerialInterface;
+	unsigned char mNumChannels;
+	bool mUsePololuProtocol;
+	unsigned char mDeviceNumber;
+	std::atomic<unsigned int> mPendingTargets[MaxNumChannels];
+	std::atomic<unsigned long long int> mNumTargetsSet;
+	std::atomic<unsigned long long int> mNumTargetsSent;
+};
+
+}
@@ -0,0 +1,136 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "RPMControlLoop.h"
+#include "RPMSeqLockRing.h"
+#include "RPMSerialInterface.h"
+
+namespace RPM
+{
+
+/* 
+	TelemetrySampler
+
+	Polls the positions of selected channels, the moving state and the errors of a device at a 
+	fixed rate on a background thread, and publishes each round as a timestamped Sample in a 
+	SeqLockRing. Consumers (a control loop, a GUI, a logger...) read the latest sample or the 
+	history from any thread, without ever waiting on the serial port or on the sampler.
+
+		RPM::TelemetrySampler sampler( serialInterface, 10000 );		// 100 Hz
+		sampler.setChannels( channelNumbers, 6 );
+		sampler.start();
+		...
+		RPM::TelemetrySampler::Sample sample;
+		if ( sampler.getLatestSample( sample ) && (sample.validQuantities & RPM::TelemetrySampler::Positions) )
+			use( sample.positions[0] );
+
+	The sampler doesn't own the SerialInterface. While it runs, it's the only one using it, 
+	unless a mutex is given with setSerialMutex(): the sampler then locks it around each round 
+	of queries, and the other threads must lock it around their own use of the interface.
+*/
+class TelemetrySampler
+{
+public:
+	enum Quantity
+	{
+		Positions = 0x01,
+		MovingState = 0x02,
+		Errors = 0x04
+	};
+
+	static const unsigned int MaxNumChannels = 24;
+
+	struct Sample
+	{
+		unsigned long long int index;					// The number of the sample, as given to getSample()
+		long long int timestampInUs;					// steady_clock time at which the responses were received
+		unsigned int roundTripInUs;						// The time spent querying the device
+		unsigned int validQuantities;					// The quantities read successfully (Quantity flags)
+		unsigned int numChannels;
+		unsigned char channelNumbers[MaxNumChannels];
+		unsigned short positions[MaxNumChannels];
+		bool servosAreMoving;
+		unsigned short errors;
+	};
+
+	// periodInUs is the sampling period, historySize the number of samples kept in the ring
+	TelemetrySampler( SerialInterface* serialInterface, unsigned int periodInUs, unsigned int historySize=1024 );
+	~TelemetrySampler();
+
+	// Configuration, only while the sampler is stopped. Return false otherwise or if invalid.
+	// By default, all the quantities are sampled with the compact protocol, and each query has 
+	// a time budget of the sampling period. The positions are only read once channels are set.
+	bool setChannels( const unsigned char* channelNumbers, unsigned int numChannels );
+	bool setQuantities( unsigned int quantities );
+	bool setProtocol( bool usePololuProtocol, unsigned char deviceNumber=12 );
+	bool setTimeout( unsigned int timeoutInMs );
+	bool setSerialMutex( std::mutex* serialMutex );
+
+	bool start();
+	void stop();
+	bool isRunning() const		{ return mThread.joinable(); }
+
+	// Readers, from any thread
+	bool getLatestSample( Sample& sample ) const						{ return mRing.readLatest( sample ); }
+	bool getSample( unsigned long long int index, Sample& sample ) const	{ return mRing.read( index, sample ); }
+	unsigned long long int getNumSamples() const						{ return mRing.getNumPushed(); }
+	unsigned int getHistorySize() const									{ return static_cast<unsigned int>(mRing.getCapacity()); }
+
+	// Copy the most recent samples still in the ring, oldest first, and return their number
+	unsigned int getHistory( Sample* samples, unsigned int maxNumSamples ) const;
+
+	// The rounds where at least one query failed
+	unsigned long long int getNumFailures() const	{ return mNumFailures.load( std::memory_order_relaxed ); }
+
+	// The statistics of the sampling thread's schedule, only meaningful once stopped
+	const ControlLoop& getControlLoop() const		{ return mControlLoop; }
+
+private:
+	TelemetrySampler( const TelemetrySampler& );
+	TelemetrySampler& operator=( const TelemetrySampler& );
+
+	void run();
+	void sample( Sample& sample );
+	static long long int getTimeInMicroseconds();
+
+	SerialInterface* mSerialInterface;
+	std::mutex* mSerialMutex;
+	std::vector<unsigned char> mChannelNumbers;
+	unsigned int mQuantities;
+	bool mUsePololuProtocol;
+	unsigned char mDeviceNumber;
+	unsigned int mTimeoutInMs;
+	ControlLoop mControlLoop;
+	SeqLockRing<Sample> mRing;
+	std::atomic<unsigned long long int> mNumFailures;
+	std::thread mThread;
+};
+
+}
@@ -0,0 +1,120 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <vector>
+
+#include "RPMShadowState.h"
+
+namespace RPM
+{
+
+/* 
+	TrajectoryGenerator
+
+	Moves channels smoothly from their current target to a new one in a given time, by 
+	streaming interpolated targets at a fixed rate, typically from the tick of a ControlLoop 
+	with the same period:
+
+		RPM::TrajectoryGenerator trajectoryGenerator( 24, 5000, 10000 );
+		RPM::ShadowState shadowState( serialInterface, 24 );
+		trajectoryGenerator.moveTo( targets, 1500, RPM::TrajectoryGenerator::MinimumJerk );
+		controlLoop.addShadowState( &shadowState );
+		controlLoop.run( serialInterface, [&]( unsigned long long int ) { 
+			return trajectoryGenerator.step( shadowState ) && trajectoryGenerator.isMoving(); } );
+
+	When a move is planned, the targets of all its samples (one per period) are computed 
+	into a buffer allocated once for each channel at construction, so stepping is a copy and 
+	neither planning nor stepping allocates memory. Moves planned together on several channels 
+	with the same duration start and end on the same samples.
+
+	A move planned while the channel is still moving starts from the current target, the 
+	velocity isn't carried over.
+*/
+class TrajectoryGenerator
+{
+public:
+	// The profiles start and end with a null velocity. The cubic profile has a discontinuous 
+	// acceleration at both ends, the minimum jerk (quintic) profile also starts and ends with a 
+	// null acceleration.
+	enum Profile
+	{
+		Linear,
+		Cubic,
+		MinimumJerk
+	};
+	
+	// The moves can last up to maxDurationInMs. The initial target of all the channels is 6000.
+	TrajectoryGenerator( unsigned char numChannels, unsigned int periodInUs, unsigned int maxDurationInMs );
+
+	unsigned char getNumChannels() const	{ return static_cast<unsigned char>(mChannels.size()); }
+	unsigned int getPeriodInUs() const		{ return mPeriodInUs; }
+
+	// Set the current target of a channel without moving it, typically to its actual position at startup
+	bool setTarget( unsigned char channelNumber, unsigned short target );
+	unsigned short getTarget( unsigned char channelNumber ) const	{ return mChannels[channelNumber].target; }
+
+	// Plan the move of a channel, or of all the channels (the targets array holds getNumChannels() 
+	// values). The move starts on the next step. Return false if a channel number, a target or 
+	// the duration is invalid, in which case nothing is planned.
+	bool moveTo( unsigned char channelNumber, unsigned short target, unsigned int durationInMs, Profile profile=MinimumJerk );
+	bool moveTo( const unsigned short* targets, unsigned int durationInMs, Profile profile=MinimumJerk );
+
+	// Stop a channel, or all the channels, where they are
+	void stop( unsigned char channelNumber );
+	void stop();
+
+	bool isMoving( unsigned char channelNumber ) const;
+	bool isMoving() const;
+
+	// Advance all the moving channels by one period
+	void step();
+	
+	// Advance by one period, set the targets of the channels that moved in the ShadowState and flush it.
+	// Return the result of the flush: from a ControlLoop tick, the targets are only queued until the 
+	// tick ends, so a failed write shows in ControlLoop::isLastTickWritten() on the next tick instead 
+	// (and the ShadowState sends the targets again if it was added to the loop).
+	bool step( ShadowState& shadowState );
+
+private:
+	struct Channel
+	{
+		Channel();
+		unsigned short target;
+		unsigned int numSamples;
+		unsigned int sampleIndex;		// The next sample, the channel is moving while sampleIndex<numSamples
+	};
+	
+	static double getProfileValue( Profile profile, double t );
+	bool planMove( unsigned char channelNumber, unsigned short target, unsigned int numSamples, Profile profile );
+	unsigned int getNumSamples( unsigned int durationInMs ) const;
+	
+	unsigned int mPeriodInUs;
+	unsigned int mMaxNumSamples;
+	std::vector<Channel> mChannels;
+	std::vector<unsigned short> mSamples;		// mMaxNumSamples samples for each channel
+	std::vector<bool> mMoved;					// The channels whose target changed on the last step
+};
+
+}
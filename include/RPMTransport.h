@@ -0,0 +1,77 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <string>
+
+#include "RPMError.h"
+
+namespace RPM
+{
+
+/* 
+	Transport
+
+	The byte stream a SerialInterface talks to the Pololu Maestro through.
+	The SerialInterface takes care of the protocol (encoding the commands and decoding 
+	the responses), the Transport only moves bytes. The platform serial ports are Transports 
+	(TransportPOSIX and TransportWindows), as is the in-memory TransportMemory.
+
+	writeBytes and readBytes return false on failure and set the error (see Error). 
+	readBytes only succeeds when all the bytes requested have been read before the timeout 
+	expires. When it gives up because of the timeout, the error code is TimeoutError.
+*/
+class Transport
+{
+public:
+	virtual ~Transport();
+
+	virtual bool isOpen() const = 0;
+	virtual bool writeBytes( const unsigned char* data, unsigned int dataSizeInBytes ) = 0;
+	virtual bool readBytes( unsigned char* data, unsigned int dataSizeInBytes, unsigned int timeoutInMs ) = 0;
+
+	// Return the last failure, and the message describing it
+	const Error& getError() const				{ return mError; }
+	std::string getErrorMessage() const			{ return mError.getMessage(); }
+
+	// Indicate whether the last read failed because the bytes didn't arrive in time
+	bool hasTimedOut() const					{ return mError.hasTimedOut(); }
+
+protected:
+	Transport();
+	void clearError()							{ mError.clear(); }
+	void setError( ErrorCode code, int systemErrorCode=0, unsigned int numBytesTransferred=0, unsigned int numBytesExpected=0, unsigned int value=0 )
+	{
+		mError.set( code, systemErrorCode, numBytesTransferred, numBytesExpected, value );
+	}
+	void setError( const Error& error )			{ mError = error; }
+
+private:
+	Transport( const Transport& );
+	Transport& operator=( const Transport& );
+
+	Error mError;
+};
+
+}
@@ -0,0 +1,89 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <vector>
+
+#include "RPMTransport.h"
+
+namespace RPM
+{
+
+class Simulator;
+
+/* 
+	TransportMemory
+
+	A Transport that never leaves the process, used to test and benchmark the library 
+	without any kernel involvement.
+	- The bytes written are counted, and only appended to an in-memory buffer when 
+	  setKeepWrittenBytes(true) was called, so a long run doesn't grow without bound.
+	- The bytes read come from a scripted response buffer, filled with addResponseBytes().
+	  When a Simulator is attached, the bytes written are also fed to it and its 
+	  responses are appended to the response buffer.
+	Once the buffers have grown to their working size, no memory is allocated.
+*/
+class TransportMemory : public Transport
+{
+public:
+	// The simulator is optional and isn't owned by the transport
+	explicit TransportMemory( Simulator* simulator=NULL );
+	virtual ~TransportMemory();
+
+	virtual bool isOpen() const			{ return true; }
+	virtual bool writeBytes( const unsigned char* data, unsigned int dataSizeInBytes );
+	virtual bool readBytes( unsigned char* data, unsigned int dataSizeInBytes, unsigned int timeoutInMs );
+
+	Simulator*	getSimulator() const	{ return mSimulator; }
+
+	// The bytes written since the last call to clearWrittenBytes(), only kept when 
+	// enabled (off by default)
+	void		setKeepWrittenBytes( bool keepWrittenBytes )	{ mKeepWrittenBytes = keepWrittenBytes; }
+	const std::vector<unsigned char>& getWrittenBytes() const	{ return mWrittenBytes; }
+	void		clearWrittenBytes()								{ mWrittenBytes.clear(); }
+
+	// Queue bytes to be returned by the next reads
+	void			addResponseBytes( const unsigned char* data, unsigned int dataSizeInBytes );
+	unsigned int	getNumResponseBytesAvailable() const;
+	void			clearResponseBytes();
+
+	// Counters since construction
+	unsigned long long int	getNumWrites() const			{ return mNumWrites; }
+	unsigned long long int	getNumBytesWritten() const		{ return mNumBytesWritten; }
+	unsigned long long int	getNumReads() const				{ return mNumReads; }
+	unsigned long long int	getNumBytesRead() const			{ return mNumBytesRead; }
+
+private:
+	Simulator*					mSimulator;
+	bool						mKeepWrittenBytes;
+	std::vector<unsigned char>	mWrittenBytes;
+	std::vector<unsigned char>	mResponseBytes;
+	std::size_t					mResponseReadPosition;
+	unsigned long long int		mNumWrites;
+	unsigned long long int		mNumBytesWritten;
+	unsigned long long int		mNumReads;
+	unsigned long long int		mNumBytesRead;
+};
+
+}
@@ -0,0 +1,66 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include "RPMTransport.h"
+
+namespace RPM
+{
+
+class TransportPOSIX : public Transport
+{
+public:
+	// Creates a POSIX serial port Transport. 
+	// The syntax of the port name depends on the platform. For example: 
+	// - on Windows: "\\\\.\\USBSER000", "\\\\.\\COM6", etc... 
+	// - on Linux: "/dev/ttyACM0"
+	// - on Mac OS: "/dev/cu.usbmodem00034567"
+	// The port is configured in raw mode, 8N1, at the given baud rate. A baud rate of 0 leaves the 
+	// current rate of the port unchanged. Rates that have no standard termios constant (such as the 
+	// Maestro's maximum of 250000) are supported on Linux and Mac OS.
+	TransportPOSIX( const std::string& portName, unsigned int baudRate, std::string* errorMessage=NULL );
+
+	virtual ~TransportPOSIX();
+
+	virtual bool isOpen() const;
+	virtual bool writeBytes( const unsigned char* data, unsigned int dataSizeInBytes );
+	virtual bool readBytes( unsigned char* data, unsigned int dataSizeInBytes, unsigned int timeoutInMs );
+
+	// The file descriptor of the port, -1 if it isn't open. For event loops only (see MultiPortController), 
+	// reading or writing it directly bypasses the transport.
+	int getFileDescriptor() const	{ return mFileDescriptor; }
+
+	// The range of baud rates supported by the Maestro TTL serial port
+	static unsigned int getMinBaudRate()	{ return 300; }
+	static unsigned int getMaxBaudRate()	{ return 250000; }
+
+private:
+	int openPort( const std::string& portName, unsigned int baudRate, std::string* errorMessage=NULL );
+	static bool setCustomBaudRate( int fileDescriptor, unsigned int baudRate );		// See RPMTransportPOSIXCustomBaudRate.cpp
+
+	int	mFileDescriptor;
+	bool mDiscardInputBeforeWrite;
+};
+
+}
\ No newline at end of file
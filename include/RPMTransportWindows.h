@@ -23,7 +23,7 @@
 */
 #pragma once
 
-#include "RPMSerialInterface.h"
+#include "RPMTransport.h"
 
 #define WIN32_LEAN_AND_MEAN 
 #define NOMINMAX 
@@ -32,28 +32,29 @@
 namespace RPM
 {
 
-class SerialInterfaceWindows : public SerialInterface
+class TransportWindows : public Transport
 {
 public:
-	// Creates a Windows SerialInterface. 
+	// Creates a Windows serial port Transport. 
 	// The port name corresponds to a file name as used by the CreateFile system fonction. 
 	// Such name can have various syntaxes, for example: 
 	// - "COM4", 
 	// - "\\\\.\\USBSER000" 
 	// - "USB#VID_1FFB&PID_0089&MI_04#6&3ad40bf600004#"
-	SerialInterfaceWindows( const std::string& portName, unsigned int baudRate, std::string* errorMessage=NULL );
+	TransportWindows( const std::string& portName, unsigned int baudRate, std::string* errorMessage=NULL );
 	
-	virtual ~SerialInterfaceWindows();
+	virtual ~TransportWindows();
 
 	virtual bool isOpen() const;
+	virtual bool writeBytes( const unsigned char* data, unsigned int dataSizeInBytes );
+	virtual bool readBytes( unsigned char* data, unsigned int dataSizeInBytes, unsigned int timeoutInMs );
 
 private:
 	static HANDLE openPort( const std::string& portName, unsigned int baudRate, std::string* errorMessage );
-	
-	virtual bool writeBytes( const unsigned char* data, unsigned int dataSizeInBytes );
-	virtual bool readBytes( unsigned char* data, unsigned int dataSizeInBytes );
 
 	HANDLE	mPortHandle;
+	DWORD	mReadTimeoutInMs;
+	bool	mDiscardInputBeforeWrite;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,410 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "RPMDevice.h"
+#include "RPMRecorder.h"
+#include "RPMSerialInterface.h"
+#include "RPMShadowState.h"
+#include "RPMSimulator.h"
+#include "RPMTransportMemory.h"
+#ifdef _WIN32
+	#include "RPMTransportWindows.h"
+#else
+	#include "RPMTransportPOSIX.h"
+#endif
+
+// Measure the throughput, the wire bytes per command and the latency of every SerialInterface method.
+// By default, the commands go to a simulated device through an in-memory transport, which measures 
+// the library alone. With --port, they go to a serial port instead (a real device or the pseudo-terminal 
+// of RapaPololuMaestroSimulator).
+// The results are printed as one JSON object per line.
+//
+// With --record, the cost of recording the commands with a Recorder is measured too, the recordings 
+// go to the files PATH.000000, PATH.000001...
+//
+// Usage: RapaPololuMaestroBench [--port PATH] [--baud N] [--iterations N] [--channels N] [--device N] [--record PATH]
+
+// Count the heap allocations, so the benchmarks can show the command path doesn't allocate memory
+static std::atomic<unsigned long long int> gNumAllocations( 0 );
+
+void* operator new( std::size_t size )
+{
+	gNumAllocations.fetch_add( 1, std::memory_order_relaxed );
+	void* p = malloc( size ? size : 1 );
+	if ( !p )
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[]( std::size_t size )
+{
+	return operator new( size );
+}
+
+void operator delete( void* p ) noexcept
+{
+	free( p );
+}
+
+void operator delete[]( void* p ) noexcept
+{
+	free( p );
+}
+
+// A Transport that counts the bytes going through another one
+class CountingTransport : public RPM::Transport
+{
+public:
+	explicit CountingTransport( RPM::Transport* transport )
+		: mTransport(transport), mNumBytesWritten(0), mNumBytesRead(0)
+	{
+	}
+
+	virtual ~CountingTransport()
+	{
+		delete mTransport;
+	}
+	
+	virtual bool isOpen() const
+	{
+		return mTransport->isOpen();
+	}
+
+	virtual bool writeBytes( const unsigned char* data, unsigned int dataSizeInBytes )
+	{
+		mNumBytesWritten += dataSizeInBytes;
+		if ( !mTransport->writeBytes( data, dataSizeInBytes ) )
+		{
+			setError( mTransport->getError() );
+			return false;
+		}
+		return true;
+	}
+
+	virtual bool readBytes( unsigned char* data, unsigned int dataSizeInBytes, unsigned int timeoutInMs )
+	{
+		mNumBytesRead += dataSizeInBytes;
+		if ( !mTransport->readBytes( data, dataSizeInBytes, timeoutInMs ) )
+		{
+			setError( mTransport->getError() );
+			return false;
+		}
+		return true;
+	}
+
+	unsigned long long int	getNumBytesWritten() const	{ return mNumBytesWritten; }
+	unsigned long long int	getNumBytesRead() const		{ return mNumBytesRead; }
+	void					resetCounters()				{ mNumBytesWritten = 0; mNumBytesRead = 0; }
+
+private:
+	RPM::Transport*			mTransport;
+	unsigned long long int	mNumBytesWritten;
+	unsigned long long int	mNumBytesRead;
+};
+
+// A benchmark calls a function repeatedly, each call sending commandsPerCall commands
+struct Benchmark
+{
+	std::string name;
+	unsigned int commandsPerCall;
+	std::function<bool( unsigned int iteration )> function;
+};
+
+static double getPercentile( const std::vector<double>& sortedValues, double percentile )
+{
+	if ( sortedValues.empty() )
+		return 0;
+	std::size_t index = static_cast<std::size_t>( percentile / 100.0 * static_cast<double>(sortedValues.size()-1) + 0.5 );
+	return sortedValues[index];
+}
+
+static void runBenchmark( const Benchmark& benchmark, unsigned int numIterations, CountingTransport* transport, const std::string& transportName, std::vector<double>& latencies )
+{
+	typedef std::chrono::steady_clock Clock;
+
+	// Warm up, so the buffers have reached their working size
+	for ( unsigned int i=0; i<std::min(numIterations, 100U); ++i )
+		benchmark.function( i );
+
+	transport->resetCounters();
+	latencies.clear();
+	unsigned int numFailures = 0;
+	unsigned long long int numAllocations = gNumAllocations.load();
+	Clock::time_point startTime = Clock::now();
+	for ( unsigned int i=0; i<numIterations; ++i )
+	{
+		Clock::time_point callStartTime = Clock::now();
+		if ( !benchmark.function( i ) )
+			numFailures++;
+		Clock::time_point callEndTime = Clock::now();
+		latencies.push_back( std::chrono::duration<double, std::micro>( callEndTime - callStartTime ).count() );
+	}
+	double seconds = std::chrono::duration<double>( Clock::now() - startTime ).count();
+	numAllocations = gNumAllocations.load() - numAllocations;
+
+	std::sort( latencies.begin(), latencies.end() );
+	double numCommands = static_cast<double>(numIterations) * benchmark.commandsPerCall;
+	printf("{\"benchmark\":\"%s\",\"transport\":\"%s\",\"calls\":%u,\"commands\":%.0f,\"failures\":%u,\"seconds\":%.6f,"
+		   "\"commandsPerSecond\":%.1f,\"bytesWrittenPerCommand\":%.3f,\"bytesReadPerCommand\":%.3f,"
+		   "\"allocationsPerCall\":%.3f,\"latencyP50Us\":%.3f,\"latencyP99Us\":%.3f,\"latencyP999Us\":%.3f}\n",
+		   benchmark.name.c_str(), transportName.c_str(), numIterations, numCommands, numFailures, seconds,
+		   seconds>0 ? numCommands/seconds : 0.0,
+		   static_cast<double>(transport->getNumBytesWritten()) / numCommands,
+		   static_cast<double>(transport->getNumBytesRead()) / numCommands,
+		   static_cast<double>(numAllocations) / numIterations,
+		   getPercentile( latencies, 50 ), getPercentile( latencies, 99 ), getPercentile( latencies, 99.9 ) );
+	fflush(stdout);
+}
+
+int main( int argc, char** argv )
+{
+	std::string portName;
+	unsigned int baudRate = 9600;
+	unsigned int numIterations = 0;
+	unsigned int numChannels = 24;
+	unsigned int deviceNumber = 12;
+	std::string recordPath;
+	for ( int i=1; i+1<argc; i+=2 )
+	{
+		std::string option = argv[i];
+		const char* value = argv[i+1];
+		if ( option=="--port" )
+			portName = value;
+		else if ( option=="--baud" )
+			baudRate = static_cast<unsigned int>( atoi(value) );
+		else if ( option=="--iterations" )
+			numIterations = static_cast<unsigned int>( atoi(value) );
+		else if ( option=="--channels" )
+			numChannels = static_cast<unsigned int>( atoi(value) );
+		else if ( option=="--device" )
+			deviceNumber = static_cast<unsigned int>( atoi(value) );
+		else if ( option=="--record" )
+			recordPath = value;
+		else
+		{
+			fprintf(stderr, "Unknown option '%s'\n", option.c_str());
+			fprintf(stderr, "Usage: %s [--port PATH] [--baud N] [--iterations N] [--channels N] [--device N] [--record PATH]\n", argv[0]);
+			return -1;
+		}
+	}
+	if ( numChannels==0 || numChannels>24 )
+	{
+		fprintf(stderr, "The number of channels must be between 1 and 24\n");
+		return -1;
+	}
+
+	// Create the transport
+	RPM::Simulator simulator( static_cast<unsigned char>(numChannels), static_cast<unsigned char>(deviceNumber) );
+	RPM::Transport* baseTransport = NULL;
+	std::string transportName;
+	if ( portName.empty() )
+	{
+		baseTransport = new RPM::TransportMemory( &simulator );
+		transportName = "memory";
+		if ( numIterations==0 )
+			numIterations = 100000;
+	}
+	else
+	{
+		std::string errorMessage;
+#ifdef _WIN32
+		baseTransport = new RPM::TransportWindows( portName, baudRate, &errorMessage );
+#else
+		baseTransport = new RPM::TransportPOSIX( portName, baudRate, &errorMessage );
+#endif
+		if ( !baseTransport->isOpen() )
+		{
+			fprintf(stderr, "Failed to open serial port. %s\n", errorMessage.c_str());
+			delete baseTransport;
+			return -1;
+		}
+		transportName = portName;
+		if ( numIterations==0 )
+			numIterations = 1000;
+	}
+	CountingTransport* transport = new CountingTransport( baseTransport );
+	RPM::SerialInterface serialInterface( transport );
+	RPM::SerialInterface* s = &serialInterface;
+
+	// The parameters of the commands
+	const unsigned char channelNumber = 0;
+	const unsigned char device = static_cast<unsigned char>(deviceNumber);
+	const unsigned char numTargets = static_cast<unsigned char>(numChannels);
+	std::vector<unsigned char> channelNumbers( numChannels );
+	std::vector<unsigned short> targets( numChannels );
+	std::vector<unsigned short> positions( numChannels );
+	std::map<unsigned char, unsigned short> targetMap;
+	for ( unsigned int i=0; i<numChannels; ++i )
+	{
+		channelNumbers[i] = static_cast<unsigned char>(i);
+		targets[i] = 6000;
+		targetMap[static_cast<unsigned char>(i)] = 6000;
+	}
+	auto getTarget = []( unsigned int iteration ) { return static_cast<unsigned short>( 4000 + iteration % 4000 ); };
+	bool servosAreMoving = false;
+	unsigned short value = 0;
+
+	std::vector<Benchmark> benchmarks;
+	benchmarks.push_back( Benchmark{ "setTargetCP", 1, [&]( unsigned int i ) { return s->setTargetCP( channelNumber, getTarget(i) ); } } );
+	benchmarks.push_back( Benchmark{ "setTargetPP", 1, [&]( unsigned int i ) { return s->setTargetPP( device, channelNumber, getTarget(i) ); } } );
+	benchmarks.push_back( Benchmark{ "setTargetMSSCP", 1, [&]( unsigned int i ) { return s->setTargetMSSCP( channelNumber, static_cast<unsigned char>(i % 255) ); } } );
+	benchmarks.push_back( Benchmark{ "setSpeedCP", 1, [&]( unsigned int i ) { return s->setSpeedCP( channelNumber, static_cast<unsigned short>(i % 100) ); } } );
+	benchmarks.push_back( Benchmark{ "setSpeedPP", 1, [&]( unsigned int i ) { return s->setSpeedPP( device, channelNumber, static_cast<unsigned short>(i % 100) ); } } );
+	benchmarks.push_back( Benchmark{ "setAccelerationCP", 1, [&]( unsigned int i ) { return s->setAccelerationCP( channelNumber, static_cast<unsigned char>(i % 100) ); } } );
+	benchmarks.push_back( Benchmark{ "setAccelerationPP", 1, [&]( unsigned int i ) { return s->setAccelerationPP( device, channelNumber, static_cast<unsigned char>(i % 100) ); } } );
+	benchmarks.push_back( Benchmark{ "setMultipleTargetsCP", numTargets, [&]( unsigned int i ) { targets[0] = getTarget(i); return s->setMultipleTargetsCP( 0, numTargets, &targets[0] ); } } );
+	benchmarks.push_back( Benchmark{ "setMultipleTargetsPP", numTargets, [&]( unsigned int i ) { targets[0] = getTarget(i); return s->setMultipleTargetsPP( device, 0, numTargets, &targets[0] ); } } );
+	benchmarks.push_back( Benchmark{ "setTargetsCP", numTargets, [&]( unsigned int i ) { targetMap[0] = getTarget(i); return s->setTargetsCP( targetMap ); } } );
+	benchmarks.push_back( Benchmark{ "setTargetsPP", numTargets, [&]( unsigned int i ) { targetMap[0] = getTarget(i); return s->setTargetsPP( device, targetMap ); } } );
+	benchmarks.push_back( Benchmark{ "getPositionCP", 1, [&]( unsigned int ) { return s->getPositionCP( channelNumber, value ); } } );
+	benchmarks.push_back( Benchmark{ "getPositionPP", 1, [&]( unsigned int ) { return s->getPositionPP( device, channelNumber, value ); } } );
+	benchmarks.push_back( Benchmark{ "getPositionsCP", numTargets, [&]( unsigned int ) { return s->getPositionsCP( &channelNumbers[0], numChannels, &positions[0] ); } } );
+	benchmarks.push_back( Benchmark{ "getPositionsPP", numTargets, [&]( unsigned int ) { return s->getPositionsPP( device, &channelNumbers[0], numChannels, &positions[0] ); } } );
+	benchmarks.push_back( Benchmark{ "getMovingStateCP", 1, [&]( unsigned int ) { return s->getMovingStateCP( servosAreMoving ); } } );
+	benchmarks.push_back( Benchmark{ "getMovingStatePP", 1, [&]( unsigned int ) { return s->getMovingStatePP( device, servosAreMoving ); } } );
+	benchmarks.push_back( Benchmark{ "getErrorsCP", 1, [&]( unsigned int ) { return s->getErrorsCP( value ); } } );
+	benchmarks.push_back( Benchmark{ "getErrorsPP", 1, [&]( unsigned int ) { return s->getErrorsPP( device, value ); } } );
+	benchmarks.push_back( Benchmark{ "goHomeCP", 1, [&]( unsigned int ) { return s->goHomeCP(); } } );
+	benchmarks.push_back( Benchmark{ "setTargetCPOutOfRange", 1, [&]( unsigned int ) { return s->setTargetCP( channelNumber, 1 ); } } );
+	benchmarks.push_back( Benchmark{ "goHomePP", 1, [&]( unsigned int ) { return s->goHomePP( device ); } } );
+	benchmarks.push_back( Benchmark{ "sendBaudRateIndication", 1, [&]( unsigned int ) { return s->sendBaudRateIndication(); } } );
+
+	// The same commands, one per channel, grouped in a single batch
+	benchmarks.push_back( Benchmark{ "batchSetTargetCP", numTargets, [&]( unsigned int i ) {
+		s->beginBatch();
+		for ( unsigned char c=0; c<numTargets; ++c )
+			s->setTargetCP( c, getTarget(i) );
+		return s->endBatch(); } } );
+	benchmarks.push_back( Benchmark{ "batchSetTargetPP", numTargets, [&]( unsigned int i ) {
+		s->beginBatch();
+		for ( unsigned char c=0; c<numTargets; ++c )
+			s->setTargetPP( device, c, getTarget(i) );
+		return s->endBatch(); } } );
+	benchmarks.push_back( Benchmark{ "batchSetTargetMSSCP", numTargets, [&]( unsigned int i ) {
+		s->beginBatch();
+		for ( unsigned char c=0; c<numTargets; ++c )
+			s->setTargetMSSCP( c, static_cast<unsigned char>(i % 255) );
+		return s->endBatch(); } } );
+	benchmarks.push_back( Benchmark{ "batchSetSpeedCP", numTargets, [&]( unsigned int i ) {
+		s->beginBatch();
+		for ( unsigned char c=0; c<numTargets; ++c )
+			s->setSpeedCP( c, static_cast<unsigned short>(i % 100) );
+		return s->endBatch(); } } );
+	benchmarks.push_back( Benchmark{ "batchSetSpeedPP", numTargets, [&]( unsigned int i ) {
+		s->beginBatch();
+		for ( unsigned char c=0; c<numTargets; ++c )
+			s->setSpeedPP( device, c, static_cast<unsigned short>(i % 100) );
+		return s->endBatch(); } } );
+	benchmarks.push_back( Benchmark{ "batchSetAccelerationCP", numTargets, [&]( unsigned int i ) {
+		s->beginBatch();
+		for ( unsigned char c=0; c<numTargets; ++c )
+			s->setAccelerationCP( c, static_cast<unsigned char>(i % 100) );
+		return s->endBatch(); } } );
+	benchmarks.push_back( Benchmark{ "batchSetAccelerationPP", numTargets, [&]( unsigned int i ) {
+		s->beginBatch();
+		for ( unsigned char c=0; c<numTargets; ++c )
+			s->setAccelerationPP( device, c, static_cast<unsigned char>(i % 100) );
+		return s->endBatch(); } } );
+	
+	// A full pose set on every call, where only one channel moves. Compare with batchSetTargetCP
+	RPM::ShadowState shadowState( s, numTargets );
+	benchmarks.push_back( Benchmark{ "shadowStatePoseCP", numTargets, [&]( unsigned int i ) {
+		for ( unsigned char c=0; c<numTargets; ++c )
+			shadowState.setTarget( c, c==0 ? getTarget(i) : 6000 );
+		return shadowState.flush(); } } );
+
+	// A pose streamed with a few quarter-microseconds of jitter on every channel, filtered by a deadband
+	RPM::ShadowState filteredShadowState( s, numTargets );
+	filteredShadowState.setTargetDeadband( 8, 100 );
+	benchmarks.push_back( Benchmark{ "shadowStateJitterCP", numTargets, [&]( unsigned int i ) {
+		for ( unsigned char c=0; c<numTargets; ++c )
+			filteredShadowState.setTarget( c, static_cast<unsigned short>( 6000 + (i*7 + c*3) % 7 ) );
+		return filteredShadowState.flush(); } } );
+
+	// The same commands through statically dispatched device handles. The device number of the 
+	// Pololu protocol handle is a template argument, fixed to PololuDeviceNumber.
+	const unsigned int PololuDeviceNumber = 12;
+	RPM::Device<RPM::Protocol::CompactProtocol, CountingTransport> compactDevice( *transport );
+	RPM::Device<RPM::Protocol::PololuDeviceProtocol<PololuDeviceNumber>, CountingTransport> pololuDevice( *transport );
+	benchmarks.push_back( Benchmark{ "deviceSetTargetCP", 1, [&]( unsigned int i ) { return compactDevice.setTarget( channelNumber, getTarget(i) ); } } );
+	benchmarks.push_back( Benchmark{ "deviceGetPositionCP", 1, [&]( unsigned int ) { return compactDevice.getPosition( channelNumber, value ); } } );
+	benchmarks.push_back( Benchmark{ "deviceBatchSetTargetCP", numTargets, [&]( unsigned int i ) {
+		compactDevice.beginBatch();
+		for ( unsigned char c=0; c<numTargets; ++c )
+			compactDevice.setTarget( c, getTarget(i) );
+		return compactDevice.endBatch(); } } );
+	benchmarks.push_back( Benchmark{ "deviceSetTargetMSSCP", 1, [&]( unsigned int i ) { return compactDevice.setTargetMSSCP( channelNumber, static_cast<unsigned char>(i % 255) ); } } );
+	benchmarks.push_back( Benchmark{ "deviceSetMultipleTargetsCP", numTargets, [&]( unsigned int i ) { targets[0] = getTarget(i); return compactDevice.setMultipleTargets( 0, numTargets, &targets[0] ); } } );
+	if ( deviceNumber==PololuDeviceNumber )
+	{
+		benchmarks.push_back( Benchmark{ "deviceBatchSetTargetPP", numTargets, [&]( unsigned int i ) {
+			pololuDevice.beginBatch();
+			for ( unsigned char c=0; c<numTargets; ++c )
+				pololuDevice.setTarget( c, getTarget(i) );
+			return pololuDevice.endBatch(); } } );
+		benchmarks.push_back( Benchmark{ "deviceSetMultipleTargetsPP", numTargets, [&]( unsigned int i ) { targets[0] = getTarget(i); return pololuDevice.setMultipleTargets( 0, numTargets, &targets[0] ); } } );
+	}
+	else
+		fprintf(stderr, "Skipping deviceBatchSetTargetPP and deviceSetMultipleTargetsPP: the Pololu protocol Device is compiled for device %u, not %u\n", PololuDeviceNumber, deviceNumber);
+
+	// The cost of recording everything sent. Compare with setTargetCP and batchSetTargetCP
+	RPM::Recorder recorder;
+	std::string recorderErrorMessage;
+	if ( !recordPath.empty() && !recorder.open( recordPath, 1024*1024, 1, &recorderErrorMessage ) )
+		fprintf(stderr, "Failed to open the recording '%s'. %s\n", recordPath.c_str(), recorderErrorMessage.c_str());
+	if ( recorder.isOpen() )
+	{
+		benchmarks.push_back( Benchmark{ "recordedSetTargetCP", 1, [&]( unsigned int i ) {
+			s->setRecorder( &recorder );
+			bool ret = s->setTargetCP( channelNumber, getTarget(i) );
+			s->setRecorder( NULL );
+			return ret; } } );
+		benchmarks.push_back( Benchmark{ "recordedBatchSetTargetCP", numTargets, [&]( unsigned int i ) {
+			s->setRecorder( &recorder );
+			s->beginBatch();
+			for ( unsigned char c=0; c<numTargets; ++c )
+				s->setTargetCP( c, getTarget(i) );
+			bool ret = s->endBatch();
+			s->setRecorder( NULL );
+			return ret; } } );
+	}
+
+	std::vector<double> latencies;
+	latencies.reserve( numIterations );
+	for ( std::size_t i=0; i<benchmarks.size(); ++i )
+		runBenchmark( benchmarks[i], numIterations, transport, transportName, latencies );
+
+	return 0;
+}
@@ -0,0 +1,139 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "RPMReplayer.h"
+#include "RPMSerialInterface.h"
+#include "RPMSimulator.h"
+#include "RPMTransportMemory.h"
+
+// Replay files recorded with RPM::Recorder, on a serial port or on an in-memory simulator.
+// The files are given in the order they were recorded. A speed of 1 replays at the recorded 
+// timing, 2 twice as fast, etc... and 0 as fast as possible, which makes the replay a load 
+// generator. One JSON line is printed for each pass.
+//
+// Usage: RapaPololuMaestroReplay [--port PATH] [--baud N] [--speed X] [--passes N] [--timeout-ms N] FILE...
+
+int main( int argc, char** argv )
+{
+	std::string portName;
+	unsigned int baudRate = 9600;
+	double speed = 1.0;
+	unsigned int numPasses = 1;
+	unsigned int timeoutInMs = 1000;
+	std::vector<std::string> filePaths;
+	for ( int i=1; i<argc; ++i )
+	{
+		std::string option = argv[i];
+		if ( option.compare( 0, 2, "--" )!=0 )
+		{
+			filePaths.push_back( option );
+			continue;
+		}
+		const char* value = i+1<argc ? argv[++i] : "";
+		if ( option=="--port" )
+			portName = value;
+		else if ( option=="--baud" )
+			baudRate = static_cast<unsigned int>( atoi(value) );
+		else if ( option=="--speed" )
+			speed = atof(value);
+		else if ( option=="--passes" )
+			numPasses = static_cast<unsigned int>( atoi(value) );
+		else if ( option=="--timeout-ms" )
+			timeoutInMs = static_cast<unsigned int>( atoi(value) );
+		else
+		{
+			fprintf(stderr, "Unknown option '%s'\n", option.c_str());
+			filePaths.clear();
+			break;
+		}
+	}
+	if ( filePaths.empty() || speed<0 )
+	{
+		fprintf(stderr, "Usage: %s [--port PATH] [--baud N] [--speed X] [--passes N] [--timeout-ms N] FILE...\n", argv[0]);
+		return -1;
+	}
+
+	RPM::Replayer replayer;
+	for ( std::size_t i=0; i<filePaths.size(); ++i )
+	{
+		std::string errorMessage;
+		if ( !replayer.loadFile( filePaths[i], &errorMessage ) )
+		{
+			fprintf(stderr, "%s\n", errorMessage.c_str());
+			return -1;
+		}
+	}
+
+	// Without a port, replay on a simulator
+	RPM::Simulator simulator;
+	RPM::SerialInterface* serialInterface = NULL;
+	std::string transportName;
+	if ( portName.empty() )
+	{
+		serialInterface = new RPM::SerialInterface( new RPM::TransportMemory( &simulator ) );
+		transportName = "memory";
+	}
+	else
+	{
+		std::string errorMessage;
+		serialInterface = RPM::SerialInterface::createSerialInterface( portName, baudRate, &errorMessage );
+		if ( !serialInterface )
+		{
+			fprintf(stderr, "Failed to open serial port. %s\n", errorMessage.c_str());
+			return -1;
+		}
+		transportName = portName;
+	}
+
+	RPM::Replayer::TimingMode timingMode = RPM::Replayer::FastestTiming;
+	if ( speed==1.0 )
+		timingMode = RPM::Replayer::OriginalTiming;
+	else if ( speed>0 )
+		timingMode = RPM::Replayer::ScaledTiming;
+
+	int ret = 0;
+	for ( unsigned int pass=0; pass<numPasses; ++pass )
+	{
+		RPM::Replayer::Report report;
+		if ( !replayer.replay( serialInterface, timingMode, speed, &report, timeoutInMs ) )
+			ret = -1;
+		double seconds = static_cast<double>(report.durationInUs) / 1e6;
+		printf("{\"pass\":%u,\"transport\":\"%s\",\"speed\":%.3f,\"writes\":%llu,\"reads\":%llu,\"bytesWritten\":%llu,\"bytesRead\":%llu,"
+			   "\"failures\":%llu,\"mismatchedResponses\":%llu,\"recordedSeconds\":%.6f,\"seconds\":%.6f,\"writesPerSecond\":%.1f,"
+			   "\"meanDriftUs\":%llu,\"p99DriftUs\":%llu,\"maxDriftUs\":%llu}\n",
+			   pass, transportName.c_str(), speed, report.numWrites, report.numReads, report.numBytesWritten, report.numBytesRead,
+			   report.numFailures, report.numMismatchedResponses, static_cast<double>(report.recordedDurationInUs) / 1e6, seconds,
+			   seconds>0 ? static_cast<double>(report.numWrites) / seconds : 0.0,
+			   report.meanDriftInUs, report.p99DriftInUs, report.maxDriftInUs );
+		fflush(stdout);
+	}
+
+	delete serialInterface;
+	return ret;
+}
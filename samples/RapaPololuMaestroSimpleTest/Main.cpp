@@ -34,6 +34,7 @@
 #endif
 
 #include "RPMSerialInterface.h"
+#include "RPMControlLoop.h"
 
 // A utility class to provide cross-platform sleep and simple time methods
 class Utils
@@ -69,23 +70,26 @@ int main(int /*argc*/, char** /*argv*/)
 		return -1;
 	}
 
-	// Generate a sinusoid signal to send to the PololuInterface
+	// Generate a sinusoid signal to send to the PololuInterface, at 200 Hz for 5 seconds.
+	// The time of a tick is derived from its index, the control loop keeps the period exact.
 	const float pi = 3.141592653589793f;
 	const unsigned int channelMinValue = 4000;
 	const unsigned int channelMaxValue = 8000;
 	const unsigned int channelValueRange = channelMaxValue - channelMinValue;
 	const unsigned int signalPeriodInMs = 2000;
-	unsigned int time0 = Utils::getTimeAsMilliseconds();
-	unsigned int timeSinceStart = 0;
-	while ( timeSinceStart < 5000 )
+	RPM::ControlLoop controlLoop( 5000 );
+	controlLoop.run( serialInterface, [&]( unsigned long long int tickIndex )
 	{
+		float timeSinceStart = static_cast<float>( tickIndex * controlLoop.getPeriodInUs() ) / 1000.f;
 		float k = sin( (pi*2)/signalPeriodInMs * timeSinceStart ) * (float)(channelValueRange/2);
 		float channelValue = (float)channelMinValue + (float)channelValueRange/2 + k;
 		printf("\rchannelValue=%d", (unsigned int)channelValue );
 		serialInterface->setTargetCP( channelNumber, (unsigned short)channelValue );
-		timeSinceStart = Utils::getTimeAsMilliseconds() - time0;
-		Utils::sleep(5);
-	}
+		return timeSinceStart < 5000;
+	} );
+	printf("\n%llu ticks, %llu overruns, %llu failed, jitter p50=%lluus p99=%lluus max=%lluus\n", 
+		controlLoop.getNumTicks(), controlLoop.getNumOverruns(), controlLoop.getNumFailedTicks(), controlLoop.getJitterPercentileInUs(50), 
+		controlLoop.getJitterPercentileInUs(99), controlLoop.getMaxJitterInUs() );
 
 	// Test all the SerialInterface methods 
 	unsigned short position = 0;
@@ -0,0 +1,224 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "RPMSimulator.h"
+
+// Simulate a Pololu Maestro on a pseudo-terminal.
+// The path of the slave side is printed at startup, a SerialInterface can be created on it
+// like on a real device. The simulator models the time the bytes take on the wire at the 
+// given baud rate (0 for a USB connection, where it's negligible) and the time the device 
+// takes to process a command.
+//
+// Usage: RapaPololuMaestroSimulator [--channels N] [--device N] [--baud N] [--latency-us N] [--link PATH]
+
+static volatile sig_atomic_t gStopRequested = 0;
+
+static void onSignal( int /*signal*/ )
+{
+	gStopRequested = 1;
+}
+
+static unsigned long long int getTimeInMicroseconds()
+{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return static_cast<unsigned long long int>(now.tv_sec) * 1000000ULL + now.tv_nsec / 1000;
+}
+
+// Bytes in flight, either received from the host and waiting to be processed, 
+// or responses waiting to be sent back
+struct Chunk
+{
+	unsigned long long int		dueTime;
+	std::vector<unsigned char>	bytes;
+};
+
+int main( int argc, char** argv )
+{
+	unsigned int numChannels = 24;
+	unsigned int deviceNumber = 12;
+	unsigned int baudRate = 0;
+	unsigned int latencyInMicroseconds = 0;
+	std::string linkPath;
+	for ( int i=1; i+1<argc; i+=2 )
+	{
+		std::string option = argv[i];
+		const char* value = argv[i+1];
+		if ( option=="--channels" )
+			numChannels = static_cast<unsigned int>( atoi(value) );
+		else if ( option=="--device" )
+			deviceNumber = static_cast<unsigned int>( atoi(value) );
+		else if ( option=="--baud" )
+			baudRate = static_cast<unsigned int>( atoi(value) );
+		else if ( option=="--latency-us" )
+			latencyInMicroseconds = static_cast<unsigned int>( atoi(value) );
+		else if ( option=="--link" )
+			linkPath = value;
+		else
+		{
+			printf("Unknown option '%s'\n", option.c_str());
+			printf("Usage: %s [--channels N] [--device N] [--baud N] [--latency-us N] [--link PATH]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	int masterFileDescriptor = posix_openpt( O_RDWR | O_NOCTTY );
+	if ( masterFileDescriptor==-1 || grantpt(masterFileDescriptor)!=0 || unlockpt(masterFileDescriptor)!=0 )
+	{
+		printf("Failed to create pseudo-terminal. %s\n", strerror(errno));
+		return -1;
+	}
+	std::string slaveName = ptsname( masterFileDescriptor );
+
+	// Keep the slave side open so the master doesn't see a hang-up between two clients,
+	// and make it raw so the protocol bytes go through untouched
+	int slaveFileDescriptor = open( slaveName.c_str(), O_RDWR | O_NOCTTY );
+	if ( slaveFileDescriptor==-1 )
+	{
+		printf("Failed to open pseudo-terminal '%s'. %s\n", slaveName.c_str(), strerror(errno));
+		return -1;
+	}
+	struct termios options;
+	tcgetattr( slaveFileDescriptor, &options );
+	cfmakeraw( &options );
+	tcsetattr( slaveFileDescriptor, TCSANOW, &options );
+
+	if ( !linkPath.empty() )
+	{
+		unlink( linkPath.c_str() );
+		if ( symlink( slaveName.c_str(), linkPath.c_str() )!=0 )
+		{
+			printf("Failed to create link '%s'. %s\n", linkPath.c_str(), strerror(errno));
+			return -1;
+		}
+	}
+
+	signal( SIGINT, onSignal );
+	signal( SIGTERM, onSignal );
+
+	printf("Simulating a Pololu Maestro with %d channels (device number %d) on %s\n", numChannels, deviceNumber, slaveName.c_str());
+	if ( !linkPath.empty() )
+		printf("Linked as %s\n", linkPath.c_str());
+	printf("Wire baud rate: %d, processing latency: %d us\n", baudRate, latencyInMicroseconds);
+	fflush(stdout);
+
+	RPM::Simulator simulator( static_cast<unsigned char>(numChannels), static_cast<unsigned char>(deviceNumber) );
+	
+	// A byte takes 10 bits on the wire (start, 8 data bits, stop)
+	const unsigned long long int bitsPerByte = 10;
+	std::deque<Chunk> receivedChunks;
+	std::deque<Chunk> responseChunks;
+	unsigned long long int receiveWireFreeTime = 0;
+	unsigned long long int transmitWireFreeTime = 0;
+	unsigned long long int lastUpdateTime = getTimeInMicroseconds();
+	std::vector<unsigned char> response;
+	unsigned char buffer[4096];
+
+	while ( !gStopRequested )
+	{
+		unsigned long long int now = getTimeInMicroseconds();
+		simulator.update( static_cast<unsigned int>(now - lastUpdateTime) );
+		lastUpdateTime = now;
+
+		// Process the received bytes that are due
+		while ( !receivedChunks.empty() && receivedChunks.front().dueTime<=now )
+		{
+			Chunk& chunk = receivedChunks.front();
+			response.clear();
+			simulator.processBytes( &chunk.bytes[0], static_cast<unsigned int>(chunk.bytes.size()), response );
+			if ( !response.empty() )
+			{
+				unsigned long long int wireTime = baudRate>0 ? (response.size() * bitsPerByte * 1000000ULL) / baudRate : 0;
+				transmitWireFreeTime = std::max( transmitWireFreeTime, now ) + wireTime;
+				Chunk responseChunk;
+				responseChunk.dueTime = transmitWireFreeTime;
+				responseChunk.bytes = response;
+				responseChunks.push_back( responseChunk );
+			}
+			receivedChunks.pop_front();
+		}
+
+		// Send the responses that are due
+		while ( !responseChunks.empty() && responseChunks.front().dueTime<=now )
+		{
+			Chunk& chunk = responseChunks.front();
+			ssize_t ret = write( masterFileDescriptor, &chunk.bytes[0], chunk.bytes.size() );
+			if ( ret==-1 && errno!=EINTR && errno!=EAGAIN )
+				printf("Failed to write response. %s\n", strerror(errno));
+			responseChunks.pop_front();
+		}
+
+		// Sleep until the next chunk is due, new bytes arrive, or the next simulation period
+		unsigned long long int nextDueTime = now + 10000;
+		if ( !receivedChunks.empty() )
+			nextDueTime = std::min( nextDueTime, receivedChunks.front().dueTime );
+		if ( !responseChunks.empty() )
+			nextDueTime = std::min( nextDueTime, responseChunks.front().dueTime );
+		int timeoutInMs = static_cast<int>( (nextDueTime - now + 999) / 1000 );
+
+		struct pollfd pollDescriptor;
+		pollDescriptor.fd = masterFileDescriptor;
+		pollDescriptor.events = POLLIN;
+		pollDescriptor.revents = 0;
+		int ret = poll( &pollDescriptor, 1, timeoutInMs );
+		if ( ret<=0 || !(pollDescriptor.revents & POLLIN) )
+			continue;
+
+		ssize_t numBytesRead = read( masterFileDescriptor, buffer, sizeof(buffer) );
+		if ( numBytesRead<=0 )
+			continue;
+
+		// The bytes are available to the device once they've gone through the wire, 
+		// and the device needs some time to process them
+		now = getTimeInMicroseconds();
+		unsigned long long int wireTime = baudRate>0 ? (static_cast<unsigned long long int>(numBytesRead) * bitsPerByte * 1000000ULL) / baudRate : 0;
+		receiveWireFreeTime = std::max( receiveWireFreeTime, now ) + wireTime;
+		Chunk chunk;
+		chunk.dueTime = receiveWireFreeTime + latencyInMicroseconds;
+		chunk.bytes.assign( buffer, buffer + numBytesRead );
+		receivedChunks.push_back( chunk );
+	}
+
+	printf("Stopping simulator (%d commands processed)\n", simulator.getNumCommandsProcessed());
+	if ( !linkPath.empty() )
+		unlink( linkPath.c_str() );
+	close( slaveFileDescriptor );
+	close( masterFileDescriptor );
+	return 0;
+}
@@ -34,23 +34,40 @@ namespace RPM
 QSerialInterfaceWidget::QSerialInterfaceWidget( QWidget* parent, SerialInterface* serialInterface, unsigned char numChannels, Qt::WindowFlags flags )
 	: QFrame(parent, flags),
 	  mSerialInterface(serialInterface),
+	  mWorkerThread(NULL),
+	  mWorker(NULL),
+	  mRefreshPending(false),
+	  mFlushPending(false),
 	  mUpdateTimer(NULL),
+	  mFlushTimer(NULL),
 	  mGoHomeButton(NULL),
 	  mAutoRefreshButton(NULL),
-	  mStatusBar(NULL)
+	  mStatusBar(NULL),
+	  mChannelWidgets()
 {
 	createWidgets(numChannels);
+	startWorker(numChannels);
 }
 
 QSerialInterfaceWidget::~QSerialInterfaceWidget()
 {	
+	// Let the worker finish its current call, the interface is free afterwards
+	if ( mWorkerThread )
+	{
+		mWorkerThread->quit();
+		mWorkerThread->wait();
+	}
+	delete mWorker;
+	mWorker = NULL;
 }
 
 void QSerialInterfaceWidget::createWidgets( unsigned char numChannels )
 {
 	bool ret = false;
-	mUpdateTimer = new QTimer();
-	mUpdateTimer->setInterval(200);
+	mUpdateTimer = new QTimer(this);
+	mUpdateTimer->setInterval(50);		// The worker only reads the positions at this rate while servos move
+	mFlushTimer = new QTimer(this);
+	mFlushTimer->setInterval(16);		// About once per display frame
 	
 	QVBoxLayout* mainLayout = new QVBoxLayout();
 	setLayout(mainLayout);
@@ -76,15 +93,16 @@ void QSerialInterfaceWidget::createWidgets( unsigned char numChannels )
 
 	for ( unsigned char i=0; i<numChannels; ++i )
 	{
-		QChannelWidget* channelWidget = new QChannelWidget( this, mSerialInterface, i );
-		ret = connect( mUpdateTimer, SIGNAL( timeout() ), channelWidget, SLOT( updateWidgetsFromHardware() ) );
-		assert(ret);
-		ret = connect( channelWidget, SIGNAL( channelError(const QString&) ), this, SLOT( onChannelError(const QString&) ) );
-		assert(ret);
+		QChannelWidget* channelWidget = new QChannelWidget( this, i );
 		mainLayout->addWidget( channelWidget );
+		mChannelWidgets.push_back( channelWidget );
 	}
 	mainLayout->addStretch();
 
+	// All the channels are refreshed at once, with a single round trip to the hardware
+	ret = connect( mUpdateTimer, SIGNAL( timeout() ), SLOT( updateWidgetsFromHardware() ) );
+	assert(ret);
+
 	mStatusBar = new QStatusBar(this);
 	mainLayout->addWidget( mStatusBar );
 	
@@ -92,25 +110,127 @@ void QSerialInterfaceWidget::createWidgets( unsigned char numChannels )
 		setEnabled(false);
 }
 
-void QSerialInterfaceWidget::displayError()
+void QSerialInterfaceWidget::startWorker( unsigned char numChannels )
 {
 	if ( !mSerialInterface )
 		return;
-	QString message( mSerialInterface->getErrorMessage().c_str() );
+
+	// The worker and its slots live in the worker thread, so all the connections below are queued
+	mWorkerThread = new QThread(this);
+	mWorker = new QSerialInterfaceWorker( mSerialInterface, numChannels );
+	mWorker->moveToThread( mWorkerThread );
+
+	bool ret = false;
+	ret = connect( this, SIGNAL( refreshRequested() ), mWorker, SLOT( refreshPositions() ) );
+	assert(ret);
+	ret = connect( this, SIGNAL( goHomeRequested() ), mWorker, SLOT( goHome() ) );
+	assert(ret);
+	ret = connect( this, SIGNAL( flushRequested() ), mWorker, SLOT( flushTargets() ) );
+	assert(ret);
+	ret = connect( mFlushTimer, SIGNAL( timeout() ), SLOT( onFlushTimerTimeout() ) );
+	assert(ret);
+	ret = connect( mWorker, SIGNAL( targetsFlushed() ), this, SLOT( onTargetsFlushed() ) );
+	assert(ret);
+	ret = connect( mWorker, SIGNAL( channelInitialized(int, int) ), this, SLOT( onChannelInitialized(int, int) ) );
+	assert(ret);
+	ret = connect( mWorker, SIGNAL( positionsRead(const QVariantList&) ), this, SLOT( onPositionsRead(const QVariantList&) ) );
+	assert(ret);
+	ret = connect( mWorker, SIGNAL( positionsUnchanged() ), this, SLOT( onPositionsUnchanged() ) );
+	assert(ret);
+	ret = connect( mWorker, SIGNAL( refreshFailed(const QString&) ), this, SLOT( onRefreshFailed(const QString&) ) );
+	assert(ret);
+	ret = connect( mWorker, SIGNAL( errorOccurred(const QString&) ), this, SLOT( onChannelError(const QString&) ) );
+	assert(ret);
+	for ( std::size_t i=0; i<mChannelWidgets.size(); ++i )
+	{
+		QChannelWidget* channelWidget = mChannelWidgets[i];
+		ret = connect( channelWidget, SIGNAL( targetChanged(int, int) ), this, SLOT( onTargetChanged(int, int) ) );
+		assert(ret);
+		ret = connect( channelWidget, SIGNAL( speedChanged(int, int) ), mWorker, SLOT( setSpeed(int, int) ) );
+		assert(ret);
+		ret = connect( channelWidget, SIGNAL( accelerationChanged(int, int) ), mWorker, SLOT( setAcceleration(int, int) ) );
+		assert(ret);
+	}
+	(void)ret;
+
+	mWorkerThread->start();
+	QMetaObject::invokeMethod( mWorker, "initializeChannels", Qt::QueuedConnection );
+	updateWidgetsFromHardware();
+}
+
+void QSerialInterfaceWidget::updateWidgetsFromHardware()
+{
+	if ( !mWorker || mRefreshPending )
+		return;
+	mRefreshPending = true;
+	emit refreshRequested();
+}
+
+void QSerialInterfaceWidget::onPositionsRead( const QVariantList& positions )
+{
+	mRefreshPending = false;
+	for ( int i=0; i<positions.size() && i<static_cast<int>(mChannelWidgets.size()); ++i )
+		mChannelWidgets[i]->setPosition( static_cast<unsigned short>( positions[i].toInt() ) );
+}
+
+void QSerialInterfaceWidget::onPositionsUnchanged()
+{
+	mRefreshPending = false;
+}
+
+void QSerialInterfaceWidget::onRefreshFailed( const QString& message )
+{
+	mRefreshPending = false;
 	onChannelError( message );
 }
 
+void QSerialInterfaceWidget::onChannelInitialized( int channelNumber, int target )
+{
+	if ( channelNumber>=0 && channelNumber<static_cast<int>(mChannelWidgets.size()) )
+		mChannelWidgets[channelNumber]->setTarget( static_cast<unsigned short>(target) );
+}
+
 void QSerialInterfaceWidget::onChannelError( const QString& message )
 {
 	mStatusBar->showMessage( message, 2000 );
 }
 
+void QSerialInterfaceWidget::onTargetChanged( int channelNumber, int target )
+{
+	if ( !mWorker )
+		return;
+	mWorker->getTargetCoalescer().setTarget( static_cast<unsigned char>(channelNumber), static_cast<unsigned short>(target) );
+	if ( !mFlushTimer->isActive() )
+		mFlushTimer->start();
+}
+
+void QSerialInterfaceWidget::onFlushTimerTimeout()
+{
+	// The timer only runs while the targets are being edited
+	if ( mFlushPending )
+		return;
+	if ( mWorker && mWorker->getTargetCoalescer().hasPendingTargets() )
+	{
+		mFlushPending = true;
+		emit flushRequested();
+	}
+	else
+		mFlushTimer->stop();
+}
+
+void QSerialInterfaceWidget::onTargetsFlushed()
+{
+	mFlushPending = false;
+}
+
 void QSerialInterfaceWidget::onGoHomeButtonClicked(bool /*checked*/)
 {
-	if ( !mSerialInterface )
+	if ( !mWorker )
 		return;
-	if ( !mSerialInterface->goHomeCP() )
-		displayError();
+	// The targets edited before the click would undo the Go Home once flushed. A flush already 
+	// requested runs before it, the queued signals being processed in order.
+	mWorker->getTargetCoalescer().clear();
+	emit goHomeRequested();
 }
 
 void QSerialInterfaceWidget::onAutoRefreshButtonClicked(bool checked)
@@ -128,9 +248,8 @@ void QSerialInterfaceWidget::onAutoRefreshButtonClicked(bool checked)
 /*
 	QChannelWidget
 */
-QChannelWidget::QChannelWidget( QWidget* parent, SerialInterface* serialInterface, unsigned char channelNumber  )
+QChannelWidget::QChannelWidget( QWidget* parent, unsigned char channelNumber )
 	: QWidget(parent),
-	  mSerialInterface(serialInterface),
 	  mChannelNumber(channelNumber),
 	  mTargetValue( SerialInterface::getMinChannelValue() ),
 	  mPositionSpinBox(NULL),
@@ -139,19 +258,8 @@ QChannelWidget::QChannelWidget( QWidget* parent, SerialInterface* serialInterfac
 	  mSpeedSpinBox(NULL),
 	  mAccelerationSpinBox(NULL)
 {
-	if ( mSerialInterface )
-	{
-		if ( !mSerialInterface->getPositionCP(mChannelNumber, mTargetValue) )
-			displayError();
-		if ( !mSerialInterface->setSpeedCP(mChannelNumber, 0) )
-			displayError();
-		if ( !mSerialInterface->setAccelerationCP(mChannelNumber, 0) )
-			displayError();
-	}
-
 	createWidgets();
 	updateWidgets();
-	updateWidgetsFromHardware();
 }
 
 void QChannelWidget::createWidgets()
@@ -211,29 +319,17 @@ void QChannelWidget::createWidgets()
 	ret = connect( mAccelerationSpinBox, SIGNAL(valueChanged(int)), SLOT(onAccelerationSpinBoxChanged(int)) );
 	assert(ret);
 	mainLayout->addWidget( mAccelerationSpinBox );
-
-	if ( !mSerialInterface )
-		setEnabled(false);
 }
 
-void QChannelWidget::displayError()
+void QChannelWidget::setPosition( unsigned short position )
 {
-	if ( !mSerialInterface )
-		return;
-//	QMessageBox::critical( this, "Error", mSerialInterface->getErrorMessage().c_str() );
-	QString message( mSerialInterface->getErrorMessage().c_str() );
-	emit channelError(message);
+	mPositionSpinBox->setValue(position);
 }
 
-void QChannelWidget::updateWidgetsFromHardware()
+void QChannelWidget::setTarget( unsigned short target )
 {
-	if ( !mSerialInterface )
-		return;
-	unsigned short position = 0;
-	if ( !mSerialInterface->getPositionCP(mChannelNumber, position) )
-		displayError();
-	else
-		mPositionSpinBox->setValue(position);
+	mTargetValue = target;
+	updateWidgets();
 }
 
 void QChannelWidget::updateWidgets()
@@ -255,44 +351,27 @@ void QChannelWidget::updateWidgets()
 
 void QChannelWidget::onPositionSpinBoxChanged( int value )
 {
-	if ( !mSerialInterface )
-		return;
-	unsigned short targetValue = static_cast<unsigned short>(value);
-	if ( !mSerialInterface->setTargetCP( mChannelNumber, targetValue ) )
-		displayError();
-	else
-		mTargetValue = targetValue;
-
+	// The worker reports the errors, the target is displayed as requested
+	mTargetValue = static_cast<unsigned short>(value);
+	emit targetChanged( mChannelNumber, value );
 	updateWidgets();
 }
 
 void QChannelWidget::onPositionSliderChanged( int value )
 {
-	if ( !mSerialInterface )
-		return;
-	unsigned short targetValue = static_cast<unsigned short>(value);
-	if ( !mSerialInterface->setTargetCP( mChannelNumber, targetValue ) )
-		displayError();
-	else
-		mTargetValue = targetValue;
-
+	mTargetValue = static_cast<unsigned short>(value);
+	emit targetChanged( mChannelNumber, value );
 	updateWidgets();
 }
 
 void QChannelWidget::onSpeedSpinBoxChanged( int value )
 {
-	if ( !mSerialInterface )
-		return;
-	if ( !mSerialInterface->setSpeedCP( mChannelNumber, static_cast<unsigned short>(value) ) )
-		displayError();
+	emit speedChanged( mChannelNumber, value );
 }
 
 void QChannelWidget::onAccelerationSpinBoxChanged( int value )
 {
-	if ( !mSerialInterface )
-		return;
-	if ( !mSerialInterface->setAccelerationCP( mChannelNumber, static_cast<unsigned char>(value) ) )
-		displayError();
+	emit accelerationChanged( mChannelNumber, value );
 }
 
 }
\ No newline at end of file
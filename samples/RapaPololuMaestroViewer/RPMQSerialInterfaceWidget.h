@@ -31,6 +31,7 @@
 	#pragma warning ( disable : 4800 )
 #endif
 #include <QTimer>
+#include <QThread>
 #include <QFrame>
 #include <QPushButton>
 #include <QLayout>
@@ -43,13 +44,26 @@
 	#pragma warning(pop)
 #endif
 
+#include <vector>
+
 #include "RPMSerialInterface.h"
+#include "RPMQSerialInterfaceWorker.h"
 
 namespace RPM
 {
 
 class QChannelWidget;
 
+/*
+	QSerialInterfaceWidget
+
+	The serial I/O runs on a worker thread (see QSerialInterfaceWorker), the widgets only 
+	exchange queued signals with it. A refresh is only requested once the previous one has 
+	completed, so a stalled port doesn't pile up requests. The targets edited are coalesced 
+	and flushed at most once per display frame while edits are pending, and likewise only 
+	once the previous flush has completed.
+	The interface must outlive the widget, and not be used by anything else meanwhile.
+*/
 class QSerialInterfaceWidget :	public QFrame							
 { 
 	Q_OBJECT
@@ -58,23 +72,44 @@ public:
 	QSerialInterfaceWidget( QWidget* parent, SerialInterface* serialInterface, unsigned char numChannels, Qt::WindowFlags flags=0 );
 	virtual ~QSerialInterfaceWidget();
 
-	SerialInterface*	getSerialInterface() const  { return mSerialInterface; }
 	QStatusBar*			getStatusBar() const		{ return mStatusBar; }
 
+public slots:
+	void				updateWidgetsFromHardware();
+
+signals:
+	void				refreshRequested();
+	void				goHomeRequested();
+	void				flushRequested();
+
 protected slots:
 	void				onChannelError( const QString& message );
+	void				onTargetChanged( int channelNumber, int target );
+	void				onFlushTimerTimeout();
+	void				onTargetsFlushed();
+	void				onChannelInitialized( int channelNumber, int target );
+	void				onPositionsRead( const QVariantList& positions );
+	void				onPositionsUnchanged();
+	void				onRefreshFailed( const QString& message );
 	void				onGoHomeButtonClicked(bool checked);
 	void				onAutoRefreshButtonClicked(bool checked);
 
 private:
 	void				createWidgets( unsigned char numChannels );
-	void				displayError();
+	void				startWorker( unsigned char numChannels );
 
-	SerialInterface*	mSerialInterface;
+	SerialInterface*			mSerialInterface;
+	QThread*					mWorkerThread;
+	QSerialInterfaceWorker*		mWorker;
+	bool						mRefreshPending;
+	bool						mFlushPending;
 	QTimer*				mUpdateTimer;
+	QTimer*				mFlushTimer;
 	QPushButton*		mGoHomeButton;
 	QPushButton*		mAutoRefreshButton;
 	QStatusBar*			mStatusBar;
+
+	std::vector<QChannelWidget*>	mChannelWidgets;
 };
 
 class QChannelWidget : public QWidget
@@ -82,13 +117,20 @@ class QChannelWidget : public QWidget
 	Q_OBJECT
 	
 public:
-	QChannelWidget( QWidget* parent, SerialInterface* serialInterface, unsigned char channelNumber  );
+	QChannelWidget( QWidget* parent, unsigned char channelNumber );
 
-signals:
-	void channelError(const QString& message);
+	unsigned char getChannelNumber() const	{ return mChannelNumber; }
+	
+	// Display the position read from the hardware
+	void setPosition( unsigned short position );
 
-public slots:
-	void updateWidgetsFromHardware();
+	// Display the target of the hardware, without sending it back
+	void setTarget( unsigned short target );
+
+signals:
+	void targetChanged( int channelNumber, int target );
+	void speedChanged( int channelNumber, int speed );
+	void accelerationChanged( int channelNumber, int acceleration );
 
 private slots:
 	void onPositionSpinBoxChanged( int value );
@@ -99,9 +141,7 @@ private slots:
 private:
 	void createWidgets();
 	void updateWidgets();
-	void displayError();
 
-	SerialInterface*	mSerialInterface;
 	unsigned char		mChannelNumber;
 	unsigned short		mTargetValue;	// When setting the target to Maestro, we cache the value and use it for the UI. It differs from the actual position returned by the Maestro 
 
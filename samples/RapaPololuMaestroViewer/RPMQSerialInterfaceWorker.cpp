@@ -0,0 +1,135 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RPMQSerialInterfaceWorker.h"
+
+namespace RPM
+{
+
+QSerialInterfaceWorker::QSerialInterfaceWorker( SerialInterface* serialInterface, unsigned char numChannels )
+	: QObject(NULL),
+	  mSerialInterface(serialInterface),
+	  mChannelNumbers(),
+	  mRefreshPolicy(serialInterface, numChannels),
+	  mTargetCoalescer(serialInterface, numChannels)
+{
+	for ( unsigned char i=0; i<numChannels; ++i )
+		mChannelNumbers.push_back( i );
+	mRefreshPolicy.setIntervals( 50, 1600 );
+}
+
+void QSerialInterfaceWorker::initializeChannels()
+{
+	if ( !mSerialInterface || mChannelNumbers.empty() )
+		return;
+
+	// The positions of all the channels in one round trip
+	unsigned int numChannels = static_cast<unsigned int>( mChannelNumbers.size() );
+	std::vector<unsigned short> positions( numChannels, SerialInterface::getMinChannelValue() );
+	if ( mSerialInterface->getPositionsCP( &mChannelNumbers[0], numChannels, &positions[0] ) )
+	{
+		for ( std::size_t i=0; i<mChannelNumbers.size(); ++i )
+			emit channelInitialized( mChannelNumbers[i], positions[i] );
+	}
+	else
+		reportError();
+
+	// And the speeds and accelerations in one write
+	mSerialInterface->beginBatch();
+	bool ret = true;
+	for ( std::size_t i=0; i<mChannelNumbers.size() && ret; ++i )
+		ret = mSerialInterface->setSpeedCP( mChannelNumbers[i], 0 ) && mSerialInterface->setAccelerationCP( mChannelNumbers[i], 0 );
+	if ( !mSerialInterface->endBatch() )
+		ret = false;
+	if ( !ret )
+		reportError();
+}
+
+void QSerialInterfaceWorker::refreshPositions()
+{
+	if ( !mSerialInterface || mChannelNumbers.empty() )
+		return;
+
+	bool positionsWereRead = false;
+	if ( mRefreshPolicy.isRefreshDue() && !mRefreshPolicy.refresh( positionsWereRead ) )
+	{
+		emit refreshFailed( QString( mSerialInterface->getErrorMessage().c_str() ) );
+		return;
+	}
+	if ( !positionsWereRead )
+	{
+		emit positionsUnchanged();
+		return;
+	}
+
+	const std::vector<unsigned short>& readPositions = mRefreshPolicy.getPositions();
+	QVariantList positions;
+	for ( std::size_t i=0; i<readPositions.size(); ++i )
+		positions.append( static_cast<int>(readPositions[i]) );
+	emit positionsRead( positions );
+}
+
+void QSerialInterfaceWorker::flushTargets()
+{
+	if ( mSerialInterface && mTargetCoalescer.hasPendingTargets() )
+	{
+		if ( !mTargetCoalescer.flush() )
+			reportError();
+		mRefreshPolicy.forceRefresh();
+	}
+	emit targetsFlushed();
+}
+
+void QSerialInterfaceWorker::setSpeed( int channelNumber, int speed )
+{
+	if ( !mSerialInterface )
+		return;
+	if ( !mSerialInterface->setSpeedCP( static_cast<unsigned char>(channelNumber), static_cast<unsigned short>(speed) ) )
+		reportError();
+	mRefreshPolicy.forceRefresh();
+}
+
+void QSerialInterfaceWorker::setAcceleration( int channelNumber, int acceleration )
+{
+	if ( !mSerialInterface )
+		return;
+	if ( !mSerialInterface->setAccelerationCP( static_cast<unsigned char>(channelNumber), static_cast<unsigned char>(acceleration) ) )
+		reportError();
+	mRefreshPolicy.forceRefresh();
+}
+
+void QSerialInterfaceWorker::goHome()
+{
+	if ( !mSerialInterface )
+		return;
+	if ( !mSerialInterface->goHomeCP() )
+		reportError();
+	mRefreshPolicy.forceRefresh();
+}
+
+void QSerialInterfaceWorker::reportError()
+{
+	emit errorOccurred( QString( mSerialInterface->getErrorMessage().c_str() ) );
+}
+
+}
@@ -0,0 +1,107 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#ifdef _MSC_VER
+	#pragma warning( push )
+	#pragma warning ( disable : 4127 )
+	#pragma warning ( disable : 4231 )
+	#pragma warning ( disable : 4251 )
+	#pragma warning ( disable : 4800 )
+#endif
+#include <QObject>
+#include <QString>
+#include <QVariant>
+#ifdef _MSC_VER
+	#pragma warning(pop)
+#endif
+
+#include <vector>
+
+#include "RPMSerialInterface.h"
+#include "RPMRefreshPolicy.h"
+#include "RPMTargetCoalescer.h"
+
+namespace RPM
+{
+
+/*
+	QSerialInterfaceWorker
+
+	Does all the serial I/O of the viewer, on the thread it's moved to, so a stalled port 
+	never freezes the GUI. The widgets talk to it only through queued signals and slots: the 
+	edits come in as commands, the positions and errors go back as signals.
+	Once moved to its thread, the worker is the only one to use the interface.
+
+	The positions are only read while servos move, or after an edit (see RefreshPolicy): 
+	refreshPositions() can be called at the display rate, it mostly costs a one-byte query 
+	while the device holds a pose.
+
+	The targets don't go through signals: the widgets set them in the TargetCoalescer, from 
+	the GUI thread, and flushTargets() sends the latest ones at the rate it's called.
+*/
+class QSerialInterfaceWorker : public QObject
+{
+	Q_OBJECT
+
+public:
+	QSerialInterfaceWorker( SerialInterface* serialInterface, unsigned char numChannels );
+
+	// Can be used from any thread
+	TargetCoalescer&	getTargetCoalescer()	{ return mTargetCoalescer; }
+
+public slots:
+	// Read the initial targets (the current positions of all the channels, in one round trip) 
+	// and reset the speeds and accelerations, in one write
+	void				initializeChannels();
+
+	// Read the positions of all the channels in one round trip, if the refresh policy says so
+	void				refreshPositions();
+
+	// Send the targets set in the coalescer since the last flush, in one write. targetsFlushed() 
+	// is emitted when done, whether the write succeeded or not.
+	void				flushTargets();
+
+	void				setSpeed( int channelNumber, int speed );
+	void				setAcceleration( int channelNumber, int acceleration );
+	void				goHome();
+
+signals:
+	void				channelInitialized( int channelNumber, int target );
+	void				positionsRead( const QVariantList& positions );		// One int per channel
+	void				positionsUnchanged();
+	void				targetsFlushed();
+	void				refreshFailed( const QString& message );
+	void				errorOccurred( const QString& message );
+
+private:
+	void				reportError();
+
+	SerialInterface*				mSerialInterface;
+	std::vector<unsigned char>		mChannelNumbers;
+	RefreshPolicy					mRefreshPolicy;
+	TargetCoalescer					mTargetCoalescer;
+};
+
+}
@@ -0,0 +1,291 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RPMAsyncSerialInterface.h"
+
+namespace RPM
+{
+
+AsyncSerialInterface::AsyncSerialInterface( SerialInterface* serialInterface, unsigned int queueCapacity )
+	: mSerialInterface(serialInterface),
+	  mQueue(queueCapacity),
+	  mPendingQueries(),
+	  mStopRequested(false),
+	  mIOThreadWaiting(false),
+	  mNumFailures(0),
+	  mWakeUpMutex(),
+	  mWakeUpCondition(),
+	  mIOThread()
+{
+	mPendingQueries.reserve( mQueue.getCapacity() );
+	mIOThread = std::thread( &AsyncSerialInterface::run, this );
+}
+
+AsyncSerialInterface::~AsyncSerialInterface()
+{
+	mStopRequested = true;
+	{
+		std::lock_guard<std::mutex> lock( mWakeUpMutex );
+		mWakeUpCondition.notify_one();
+	}
+	mIOThread.join();
+
+	delete mSerialInterface;
+	mSerialInterface = NULL;
+}
+
+bool AsyncSerialInterface::setTargetCP( unsigned char channelNumber, unsigned short target )
+{
+	if ( target<SerialInterface::getMinChannelValue() || target>SerialInterface::getMaxChannelValue() )
+		return false;
+	return pushCommand<Protocol::CompactProtocol, Protocol::SetTarget>( 0, channelNumber, target );
+}
+
+bool AsyncSerialInterface::setTargetPP( unsigned char deviceNumber, unsigned char channelNumber, unsigned short target )
+{
+	if ( target<SerialInterface::getMinChannelValue() || target>SerialInterface::getMaxChannelValue() )
+		return false;
+	return pushCommand<Protocol::PololuProtocol, Protocol::SetTarget>( deviceNumber, channelNumber, target );
+}
+
+bool AsyncSerialInterface::setSpeedCP( unsigned char channelNumber, unsigned short speed )
+{
+	return pushCommand<Protocol::CompactProtocol, Protocol::SetSpeed>( 0, channelNumber, speed );
+}
+
+bool AsyncSerialInterface::setSpeedPP( unsigned char deviceNumber, unsigned char channelNumber, unsigned short speed )
+{
+	return pushCommand<Protocol::PololuProtocol, Protocol::SetSpeed>( deviceNumber, channelNumber, speed );
+}
+
+bool AsyncSerialInterface::setAccelerationCP( unsigned char channelNumber, unsigned char acceleration )
+{
+	return pushCommand<Protocol::CompactProtocol, Protocol::SetAcceleration>( 0, channelNumber, acceleration );
+}
+
+bool AsyncSerialInterface::setAccelerationPP( unsigned char deviceNumber, unsigned char channelNumber, unsigned char acceleration )
+{
+	return pushCommand<Protocol::PololuProtocol, Protocol::SetAcceleration>( deviceNumber, channelNumber, acceleration );
+}
+
+bool AsyncSerialInterface::goHomeCP()
+{
+	return pushCommand<Protocol::CompactProtocol, Protocol::GoHome>( 0 );
+}
+
+bool AsyncSerialInterface::goHomePP( unsigned char deviceNumber )
+{
+	return pushCommand<Protocol::PololuProtocol, Protocol::GoHome>( deviceNumber );
+}
+
+AsyncSerialInterface::Future AsyncSerialInterface::getPositionCP( unsigned char channelNumber )
+{
+	return pushQuery<Protocol::CompactProtocol, Protocol::GetPosition>( 0, channelNumber, PositionResponse );
+}
+
+AsyncSerialInterface::Future AsyncSerialInterface::getPositionPP( unsigned char deviceNumber, unsigned char channelNumber )
+{
+	return pushQuery<Protocol::PololuProtocol, Protocol::GetPosition>( deviceNumber, channelNumber, PositionResponse );
+}
+
+AsyncSerialInterface::Future AsyncSerialInterface::getMovingStateCP()
+{
+	return pushQuery<Protocol::CompactProtocol, Protocol::GetMovingState>( 0, 0, MovingStateResponse );
+}
+
+AsyncSerialInterface::Future AsyncSerialInterface::getMovingStatePP( unsigned char deviceNumber )
+{
+	return pushQuery<Protocol::PololuProtocol, Protocol::GetMovingState>( deviceNumber, 0, MovingStateResponse );
+}
+
+AsyncSerialInterface::Future AsyncSerialInterface::getErrorsCP()
+{
+	return pushQuery<Protocol::CompactProtocol, Protocol::GetErrors>( 0, 0, ErrorsResponse );
+}
+
+AsyncSerialInterface::Future AsyncSerialInterface::getErrorsPP( unsigned char deviceNumber )
+{
+	return pushQuery<Protocol::PololuProtocol, Protocol::GetErrors>( deviceNumber, 0, ErrorsResponse );
+}
+
+template <class ProtocolType, class CommandType>
+bool AsyncSerialInterface::pushCommand( unsigned char deviceNumber, unsigned char channelNumber, unsigned short value )
+{
+	Command command;
+	command.numBytes = static_cast<unsigned char>( Protocol::encode<ProtocolType, CommandType>( command.bytes, deviceNumber, channelNumber, value ) );
+	command.responseType = NoResponse;
+	command.promise = NULL;
+	return pushCommand( command );
+}
+
+template <class ProtocolType, class CommandType>
+AsyncSerialInterface::Future AsyncSerialInterface::pushQuery( unsigned char deviceNumber, unsigned char channelNumber, ResponseType responseType )
+{
+	Command command;
+	command.numBytes = static_cast<unsigned char>( Protocol::encode<ProtocolType, CommandType>( command.bytes, deviceNumber, channelNumber ) );
+	command.responseType = responseType;
+	return pushQuery( command );
+}
+
+bool AsyncSerialInterface::pushCommand( Command& command )
+{
+	if ( !mQueue.push(command) )
+	{
+		mNumFailures++;
+		return false;
+	}
+
+	wakeUpIOThread();
+	return true;
+}
+
+AsyncSerialInterface::Future AsyncSerialInterface::pushQuery( Command& command )
+{
+	command.promise = new std::promise<QueryResult>();
+	Future future = command.promise->get_future();
+	if ( !mQueue.push(command) )
+	{
+		mNumFailures++;
+		command.promise->set_value( QueryResult() );
+		delete command.promise;
+		return future;
+	}
+
+	wakeUpIOThread();
+	return future;
+}
+
+void AsyncSerialInterface::wakeUpIOThread()
+{
+	// Only wake the I/O thread up when it's actually sleeping. The fence pairs with the one in 
+	// run(): either the I/O thread sees the command when it checks the queue again, or this 
+	// sees it waiting. The notification is sent under the mutex, so it can't land between 
+	// that check and the wait.
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	if ( !mIOThreadWaiting.load() )
+		return;
+	std::lock_guard<std::mutex> lock( mWakeUpMutex );
+	mWakeUpCondition.notify_one();
+}
+
+unsigned int AsyncSerialInterface::getResponseSize( ResponseType responseType )
+{
+	switch ( responseType )
+	{
+	case PositionResponse:		return Protocol::GetPosition::numResponseBytes;
+	case MovingStateResponse:	return Protocol::GetMovingState::numResponseBytes;
+	case ErrorsResponse:		return Protocol::GetErrors::numResponseBytes;
+	default:					return 0;
+	}
+}
+
+void AsyncSerialInterface::completeQuery( const Command& command, bool success, const unsigned char* response )
+{
+	QueryResult result;
+	if ( success )
+	{
+		switch ( command.responseType )
+		{
+		case PositionResponse:
+			result.value = Protocol::decodePosition( response );
+			result.success = true;
+			break;
+		case MovingStateResponse:
+		{
+			bool servosAreMoving = false;
+			result.success = Protocol::decodeMovingState( response, servosAreMoving );
+			result.value = servosAreMoving ? 1 : 0;
+			break;
+		}
+		case ErrorsResponse:
+			result.value = Protocol::decodeErrors( response );
+			result.success = true;
+			break;
+		default:
+			break;
+		}
+	}
+	if ( !result.success )
+		mNumFailures++;
+	command.promise->set_value( result );
+	delete command.promise;
+}
+
+void AsyncSerialInterface::run()
+{
+	for ( ;; )
+	{
+		Command command;
+		if ( !mQueue.pop(command) )
+		{
+			if ( mStopRequested.load() )
+				break;
+
+			// Re-check the queue once the waiting flag is visible to the producers, otherwise a 
+			// command pushed in between would never wake the thread up
+			std::unique_lock<std::mutex> lock( mWakeUpMutex );
+			mIOThreadWaiting = true;
+			std::atomic_thread_fence( std::memory_order_seq_cst );
+			if ( !mQueue.pop(command) )
+			{
+				if ( !mStopRequested.load() )
+					mWakeUpCondition.wait( lock );
+				mIOThreadWaiting = false;
+				continue;
+			}
+			mIOThreadWaiting = false;
+		}
+
+		// Write everything available in the queue at once
+		mSerialInterface->beginBatch();
+		bool ret = true;
+		std::size_t numCommands = 0;
+		do
+		{
+			numCommands++;
+			mSerialInterface->mStatistics.addFrame( command.bytes, command.numBytes );
+			if ( !mSerialInterface->sendBytes( command.bytes, command.numBytes ) )
+				ret = false;
+			if ( command.responseType!=NoResponse )
+				mPendingQueries.push_back( command );
+		}
+		while ( numCommands<mQueue.getCapacity() && mQueue.pop(command) );
+		if ( !mSerialInterface->endBatch() )
+			ret = false;
+		if ( !ret && mPendingQueries.empty() )
+			mNumFailures++;
+
+		// Then read the responses in the order the queries were sent
+		for ( std::size_t i=0; i<mPendingQueries.size(); ++i )
+		{
+			const Command& query = mPendingQueries[i];
+			unsigned char response[Protocol::MaxResponseSize] = { 0x00, 0x00 };
+			if ( ret )
+				ret = mSerialInterface->readBytes( response, getResponseSize(query.responseType), SerialInterface::DefaultReadTimeout );
+			completeQuery( query, ret, response );
+		}
+		mPendingQueries.clear();
+	}
+}
+
+}
@@ -0,0 +1,194 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RPMBusManager.h"
+
+namespace RPM
+{
+
+FairMutex::FairMutex()
+	: mMutex(),
+	  mCondition(),
+	  mNextTicket(0),
+	  mServedTicket(0)
+{
+}
+
+void FairMutex::lock()
+{
+	std::unique_lock<std::mutex> lock( mMutex );
+	unsigned long long int ticket = mNextTicket++;
+	while ( mServedTicket!=ticket )
+		mCondition.wait( lock );
+}
+
+void FairMutex::unlock()
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	mServedTicket++;
+	mCondition.notify_all();
+}
+
+BusManager::BusManager( SerialInterface* serialInterface )
+	: mSerialInterface(serialInterface),
+	  mBusMutex(),
+	  mStateMutex(),
+	  mLastError(),
+	  mShadowStates(mMaxNumDevices, static_cast<ShadowState*>(NULL)),
+	  mDeviceNumbers()
+{
+}
+
+BusManager::~BusManager()
+{
+	for ( std::size_t i=0; i<mShadowStates.size(); ++i )
+		delete mShadowStates[i];
+	delete mSerialInterface;
+	mSerialInterface = NULL;
+}
+
+bool BusManager::addDevice( unsigned char deviceNumber, unsigned char numChannels )
+{
+	if ( deviceNumber>=mMaxNumDevices || mShadowStates[deviceNumber] )
+		return false;
+	std::lock_guard<std::mutex> lock( mStateMutex );
+	mShadowStates[deviceNumber] = new ShadowState( mSerialInterface, numChannels, true, deviceNumber );
+	mDeviceNumbers.push_back( deviceNumber );
+	return true;
+}
+
+bool BusManager::hasDevice( unsigned char deviceNumber ) const
+{
+	return deviceNumber<mMaxNumDevices && mShadowStates[deviceNumber]!=NULL;
+}
+
+ShadowState* BusManager::getShadowState( unsigned char deviceNumber ) const
+{
+	return hasDevice(deviceNumber) ? mShadowStates[deviceNumber] : NULL;
+}
+
+bool BusManager::setTarget( unsigned char deviceNumber, unsigned char channelNumber, unsigned short target )
+{
+	if ( !hasDevice(deviceNumber) )
+		return false;
+	std::lock_guard<std::mutex> lock( mStateMutex );
+	return mShadowStates[deviceNumber]->setTarget( channelNumber, target );
+}
+
+bool BusManager::setSpeed( unsigned char deviceNumber, unsigned char channelNumber, unsigned short speed )
+{
+	if ( !hasDevice(deviceNumber) )
+		return false;
+	std::lock_guard<std::mutex> lock( mStateMutex );
+	return mShadowStates[deviceNumber]->setSpeed( channelNumber, speed );
+}
+
+bool BusManager::setAcceleration( unsigned char deviceNumber, unsigned char channelNumber, unsigned char acceleration )
+{
+	if ( !hasDevice(deviceNumber) )
+		return false;
+	std::lock_guard<std::mutex> lock( mStateMutex );
+	return mShadowStates[deviceNumber]->setAcceleration( channelNumber, acceleration );
+}
+
+bool BusManager::flush()
+{
+	std::lock_guard<FairMutex> busLock( mBusMutex );
+	
+	// The ShadowStates encode their commands into the batch, which is written once all of them 
+	// are in, after releasing the state so the setters aren't blocked during the write
+	bool ret = true;
+	mSerialInterface->beginBatch();
+	{
+		std::lock_guard<std::mutex> stateLock( mStateMutex );
+		for ( std::size_t i=0; i<mDeviceNumbers.size(); ++i )
+		{
+			if ( !mShadowStates[mDeviceNumbers[i]]->flush() )
+				ret = false;
+		}
+	}
+	if ( !mSerialInterface->endBatch() )
+	{
+		// The ShadowStates believe the values made it to the devices, they must be sent again
+		std::lock_guard<std::mutex> stateLock( mStateMutex );
+		for ( std::size_t i=0; i<mDeviceNumbers.size(); ++i )
+			mShadowStates[mDeviceNumbers[i]]->invalidate();
+		ret = false;
+	}
+	if ( !ret )
+		mLastError = mSerialInterface->getError();
+	return ret;
+}
+
+bool BusManager::getPosition( unsigned char deviceNumber, unsigned char channelNumber, unsigned short& position, unsigned int timeoutInMs )
+{
+	std::lock_guard<FairMutex> busLock( mBusMutex );
+	bool ret = mSerialInterface->getPositionPP( deviceNumber, channelNumber, position, timeoutInMs );
+	if ( !ret )
+		mLastError = mSerialInterface->getError();
+	return ret;
+}
+
+bool BusManager::getPositions( unsigned char deviceNumber, const unsigned char* channelNumbers, unsigned int numChannels, unsigned short* positions, unsigned int timeoutInMs )
+{
+	std::lock_guard<FairMutex> busLock( mBusMutex );
+	bool ret = mSerialInterface->getPositionsPP( deviceNumber, channelNumbers, numChannels, positions, timeoutInMs );
+	if ( !ret )
+		mLastError = mSerialInterface->getError();
+	return ret;
+}
+
+bool BusManager::getMovingState( unsigned char deviceNumber, bool& servosAreMoving, unsigned int timeoutInMs )
+{
+	std::lock_guard<FairMutex> busLock( mBusMutex );
+	bool ret = mSerialInterface->getMovingStatePP( deviceNumber, servosAreMoving, timeoutInMs );
+	if ( !ret )
+		mLastError = mSerialInterface->getError();
+	return ret;
+}
+
+bool BusManager::getErrors( unsigned char deviceNumber, unsigned short& errors, unsigned int timeoutInMs )
+{
+	std::lock_guard<FairMutex> busLock( mBusMutex );
+	bool ret = mSerialInterface->getErrorsPP( deviceNumber, errors, timeoutInMs );
+	if ( !ret )
+		mLastError = mSerialInterface->getError();
+	return ret;
+}
+
+bool BusManager::execute( const std::function<bool( SerialInterface& serialInterface )>& function )
+{
+	std::lock_guard<FairMutex> busLock( mBusMutex );
+	bool ret = function( *mSerialInterface );
+	if ( !ret )
+		mLastError = mSerialInterface->getError();
+	return ret;
+}
+
+std::string BusManager::getErrorMessage()
+{
+	std::lock_guard<FairMutex> busLock( mBusMutex );
+	return mLastError.getMessage();
+}
+
+}
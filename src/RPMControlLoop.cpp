@@ -0,0 +1,216 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RPMControlLoop.h"
+
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#ifndef _WIN32
+	#include <pthread.h>
+	#include <sched.h>
+	#include <time.h>
+	#include <errno.h>
+#endif
+
+#include "RPMShadowState.h"
+
+namespace RPM
+{
+
+#if defined(__linux__)
+static long long int getTimeInNanoseconds()
+{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return static_cast<long long int>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+}
+
+// Sleep until an absolute time of the monotonic clock, restarting if a signal interrupts the sleep
+static void sleepUntil( long long int timeInNs )
+{
+	struct timespec deadline;
+	deadline.tv_sec = static_cast<time_t>( timeInNs / 1000000000LL );
+	deadline.tv_nsec = static_cast<long>( timeInNs % 1000000000LL );
+	while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL )==EINTR )
+	{
+	}
+}
+#else
+// Mac OS and Windows have no clock_nanosleep, the steady clock is their monotonic clock
+static long long int getTimeInNanoseconds()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static void sleepUntil( long long int timeInNs )
+{
+	std::this_thread::sleep_until( std::chrono::steady_clock::time_point( std::chrono::duration_cast<std::chrono::steady_clock::duration>( std::chrono::nanoseconds(timeInNs) ) ) );
+}
+#endif
+
+ControlLoop::ControlLoop( unsigned int periodInUs )
+	: mPeriodInUs(periodInUs>0 ? periodInUs : 1),
+	  mShadowStates(),
+	  mStopRequested(false),
+	  mNumTicks(0),
+	  mNumOverruns(0),
+	  mNumFailedTicks(0),
+	  mLastTickWritten(true),
+	  mMaxJitterInUs(0)
+{
+	resetStatistics();
+}
+
+void ControlLoop::resetStatistics()
+{
+	mNumTicks = 0;
+	mNumOverruns = 0;
+	mNumFailedTicks = 0;
+	mLastTickWritten = true;
+	mMaxJitterInUs = 0;
+	for ( unsigned int i=0; i<NumJitterBuckets; ++i )
+		mJitterHistogram[i] = 0;
+}
+
+void ControlLoop::addJitter( long long int jitterInNs )
+{
+	unsigned long long int jitterInUs = jitterInNs>0 ? static_cast<unsigned long long int>(jitterInNs / 1000) : 0;
+	if ( jitterInUs>mMaxJitterInUs )
+		mMaxJitterInUs = jitterInUs;
+
+	unsigned int bucket = 0;
+	while ( jitterInUs>0 && bucket<NumJitterBuckets-1 )
+	{
+		jitterInUs >>= 1;
+		bucket++;
+	}
+	mJitterHistogram[bucket]++;
+}
+
+unsigned long long int ControlLoop::getJitterPercentileInUs( double percentile ) const
+{
+	if ( mNumTicks==0 )
+		return 0;
+	unsigned long long int numTicks = 0;
+	for ( unsigned int i=0; i<NumJitterBuckets; ++i )
+	{
+		numTicks += mJitterHistogram[i];
+		if ( static_cast<double>(numTicks) >= percentile / 100.0 * static_cast<double>(mNumTicks) )
+		{
+			unsigned long long int upperBound = i==0 ? 1 : (1ULL << i);
+			return upperBound<mMaxJitterInUs ? upperBound : mMaxJitterInUs;
+		}
+	}
+	return mMaxJitterInUs;
+}
+
+void ControlLoop::run( SerialInterface* serialInterface, const TickFunction& tickFunction )
+{
+	resetStatistics();
+
+	const long long int period = static_cast<long long int>(mPeriodInUs) * 1000;
+	unsigned long long int tickIndex = 0;
+	long long int deadline = getTimeInNanoseconds();
+	while ( !mStopRequested.load() )
+	{
+		sleepUntil( deadline );
+		addJitter( getTimeInNanoseconds() - deadline );
+		mNumTicks++;
+
+		if ( serialInterface )
+			serialInterface->beginBatch();
+		bool keepRunning = tickFunction( tickIndex );
+		if ( serialInterface )
+		{
+			mLastTickWritten = serialInterface->endBatch();
+			if ( !mLastTickWritten )
+			{
+				// The ShadowStates flushed during the tick took their values as sent
+				mNumFailedTicks++;
+				for ( std::size_t i=0; i<mShadowStates.size(); ++i )
+					mShadowStates[i]->invalidate();
+			}
+		}
+		if ( !keepRunning )
+			break;
+
+		// Skip the deadlines already missed
+		deadline += period;
+		tickIndex++;
+		long long int now = getTimeInNanoseconds();
+		if ( now>deadline )
+		{
+			mNumOverruns++;
+			long long int numMissedTicks = (now - deadline) / period + 1;
+			deadline += numMissedTicks * period;
+			tickIndex += static_cast<unsigned long long int>(numMissedTicks);
+		}
+	}
+}
+
+bool ControlLoop::setThreadRealTimePriority( int priority, std::string* errorMessage )
+{
+#ifdef _WIN32
+	if ( errorMessage )
+		*errorMessage = "Real-time priority is not supported on this platform";
+	return false;
+#else
+	struct sched_param param;
+	memset( &param, 0, sizeof(param) );
+	param.sched_priority = priority;
+	int ret = pthread_setschedparam( pthread_self(), SCHED_FIFO, &param );
+	if ( ret!=0 )
+	{
+		if ( errorMessage )
+			*errorMessage = std::string("Unable to set SCHED_FIFO priority. ") + strerror(ret);
+		return false;
+	}
+	return true;
+#endif
+}
+
+bool ControlLoop::setThreadCPUAffinity( unsigned int cpuIndex, std::string* errorMessage )
+{
+#if defined(__linux__)
+	cpu_set_t cpuSet;
+	CPU_ZERO( &cpuSet );
+	CPU_SET( cpuIndex, &cpuSet );
+	int ret = pthread_setaffinity_np( pthread_self(), sizeof(cpuSet), &cpuSet );
+	if ( ret!=0 )
+	{
+		if ( errorMessage )
+			*errorMessage = std::string("Unable to set CPU affinity. ") + strerror(ret);
+		return false;
+	}
+	return true;
+#else
+	(void)cpuIndex;
+	if ( errorMessage )
+		*errorMessage = "CPU affinity is not supported on this platform";
+	return false;
+#endif
+}
+
+}
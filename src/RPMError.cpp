@@ -0,0 +1,115 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RPMError.h"
+
+#include <sstream>
+#include <string.h>
+
+namespace RPM
+{
+
+Error::Error()
+	: mCode(NoError),
+	  mSystemErrorCode(0),
+	  mNumBytesTransferred(0),
+	  mNumBytesExpected(0),
+	  mValue(0)
+{
+}
+
+void Error::set( ErrorCode code, int systemErrorCode, unsigned int numBytesTransferred, unsigned int numBytesExpected, unsigned int value )
+{
+	mCode = code;
+	mSystemErrorCode = systemErrorCode;
+	mNumBytesTransferred = numBytesTransferred;
+	mNumBytesExpected = numBytesExpected;
+	mValue = value;
+}
+
+const char* Error::getCodeName( ErrorCode code )
+{
+	switch ( code )
+	{
+	case NoError:				return "NoError";
+	case InvalidArgumentError:	return "InvalidArgument";
+	case PortClosedError:		return "PortClosed";
+	case WriteError:			return "Write";
+	case ShortWriteError:		return "ShortWrite";
+	case ReadError:				return "Read";
+	case ShortReadError:		return "ShortRead";
+	case TimeoutError:			return "Timeout";
+	case ProtocolError:			return "Protocol";
+	case DeviceError:			return "Device";
+	}
+	return "Unknown";
+}
+
+std::string Error::getMessage() const
+{
+	std::stringstream stream;
+	switch ( mCode )
+	{
+	case NoError:
+		return std::string();
+	case InvalidArgumentError:
+		stream << "Invalid argument " << mValue;
+		break;
+	case PortClosedError:
+		stream << "The serial port is not open";
+		break;
+	case WriteError:
+		stream << "Unable to write bytes to serial port";
+		break;
+	case ShortWriteError:
+		stream << "Unable to write bytes to serial port. Wrote only " << mNumBytesTransferred << " out of " << mNumBytesExpected;
+		break;
+	case ReadError:
+		stream << "Unable to read bytes from serial port";
+		break;
+	case ShortReadError:
+		stream << "Unable to read bytes from serial port. Read only " << mNumBytesTransferred << " out of " << mNumBytesExpected;
+		break;
+	case TimeoutError:
+		stream << "Timed out after " << mValue << " ms reading bytes from serial port. Read only " << mNumBytesTransferred << " out of " << mNumBytesExpected;
+		break;
+	case ProtocolError:
+		stream << "Unexpected response from the device";
+		break;
+	case DeviceError:
+		stream << "Error on the serial port device";
+		break;
+	}
+
+	if ( mSystemErrorCode!=0 )
+	{
+#ifdef _WIN32
+		stream << ". " << std::hex << "Error code 0x" << mSystemErrorCode;
+#else
+		stream << ". " << strerror(mSystemErrorCode) << " (error code " << mSystemErrorCode << ")";
+#endif
+	}
+	return stream.str();
+}
+
+}
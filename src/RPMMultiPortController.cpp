@@ -0,0 +1,334 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RPMMultiPortController.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+	#include <sys/epoll.h>
+#endif
+
+namespace RPM
+{
+
+// The events of a port, independent of epoll and poll
+enum
+{
+	ReadEvent = 0x01,
+	WriteEvent = 0x02,
+	ErrorEvent = 0x04
+};
+
+static long long int getTimeInMilliseconds()
+{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return static_cast<long long int>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+MultiPortController::Port::Port()
+	: transport(NULL),
+	  fileDescriptor(-1),
+	  output(),
+	  numBytesWritten(0),
+	  input(),
+	  numBytesRead(0),
+	  queries(),
+	  registeredEvents(0),
+	  discardInputBeforeWrite(false),
+	  error()
+{
+}
+
+MultiPortController::MultiPortController()
+	: mPorts(),
+	  mEpollFileDescriptor(-1),
+	  mReadyEvents(),
+	  mEventBuffer()
+{
+#ifdef __linux__
+	mEpollFileDescriptor = epoll_create1( EPOLL_CLOEXEC );
+#endif
+}
+
+MultiPortController::~MultiPortController()
+{
+	for ( std::size_t i=0; i<mPorts.size(); ++i )
+		delete mPorts[i].transport;
+#ifdef __linux__
+	if ( mEpollFileDescriptor!=-1 )
+		close( mEpollFileDescriptor );
+#endif
+}
+
+unsigned int MultiPortController::addPort( TransportPOSIX* transport )
+{
+	Port port;
+	port.transport = transport;
+	port.fileDescriptor = transport ? transport->getFileDescriptor() : -1;
+	port.output.reserve( 256 );
+	port.input.reserve( 64 );
+	if ( port.fileDescriptor!=-1 )
+	{
+		int flags = fcntl( port.fileDescriptor, F_GETFL );
+		if ( flags!=-1 )
+			fcntl( port.fileDescriptor, F_SETFL, flags | O_NONBLOCK );
+	}
+	mPorts.push_back( port );
+	mReadyEvents.resize( mPorts.size() );
+	return static_cast<unsigned int>(mPorts.size() - 1);
+}
+
+bool MultiPortController::isValidPort( unsigned int portIndex ) const
+{
+	return portIndex<mPorts.size() && mPorts[portIndex].fileDescriptor!=-1;
+}
+
+unsigned int MultiPortController::getWantedEvents( const Port& port ) const
+{
+	if ( port.error.isError() )
+		return 0;
+	unsigned int events = 0;
+	if ( port.numBytesWritten<port.output.size() )
+		events |= WriteEvent;
+	if ( port.numBytesRead<port.input.size() )
+		events |= ReadEvent;
+	return events;
+}
+
+bool MultiPortController::transfer( unsigned int timeoutInMs )
+{
+	// Prepare the ports: the responses expected, in the order of the queries
+	bool anythingToDo = false;
+	for ( std::size_t i=0; i<mPorts.size(); ++i )
+	{
+		Port& port = mPorts[i];
+		port.error.clear();
+		port.numBytesWritten = 0;
+		port.numBytesRead = 0;
+		std::size_t numResponseBytes = 0;
+		for ( std::size_t j=0; j<port.queries.size(); ++j )
+			numResponseBytes += port.queries[j].type==MovingStateQuery ? Protocol::GetMovingState::numResponseBytes : Protocol::MaxResponseSize;
+		port.input.resize( numResponseBytes );
+		
+		if ( port.fileDescriptor==-1 )
+		{
+			if ( !port.output.empty() )
+				port.error.set( PortClosedError );
+		}
+		else if ( !port.output.empty() )
+		{
+			if ( port.discardInputBeforeWrite )
+				tcflush( port.fileDescriptor, TCIFLUSH );
+			port.discardInputBeforeWrite = false;
+			anythingToDo = true;
+		}
+	}
+
+	// Run the loop until every port has written its commands and read its responses
+	long long int deadline = getTimeInMilliseconds() + timeoutInMs;
+	while ( anythingToDo )
+	{
+		long long int now = getTimeInMilliseconds();
+		if ( now>=deadline )
+			break;
+		if ( !waitForEvents( static_cast<int>(deadline - now) ) )
+			break;
+
+		anythingToDo = false;
+		for ( std::size_t i=0; i<mPorts.size(); ++i )
+		{
+			if ( mReadyEvents[i] )
+				processEvents( mPorts[i], mReadyEvents[i] );
+			if ( getWantedEvents( mPorts[i] ) )
+				anythingToDo = true;
+		}
+	}
+
+	// Whatever is left undone has timed out
+	bool ret = true;
+	for ( std::size_t i=0; i<mPorts.size(); ++i )
+	{
+		Port& port = mPorts[i];
+		if ( !port.error.isError() && getWantedEvents( port ) )
+		{
+			if ( port.numBytesWritten<port.output.size() )
+				port.error.set( ShortWriteError, 0, static_cast<unsigned int>(port.numBytesWritten), static_cast<unsigned int>(port.output.size()) );
+			else
+				port.error.set( TimeoutError, 0, static_cast<unsigned int>(port.numBytesRead), static_cast<unsigned int>(port.input.size()), timeoutInMs );
+			port.discardInputBeforeWrite = true;
+		}
+		if ( port.error.isError() || !decodeResponses( port ) )
+			ret = false;
+		port.output.clear();
+		port.queries.clear();
+	}
+	return ret;
+}
+
+bool MultiPortController::waitForEvents( int timeoutInMs )
+{
+	for ( std::size_t i=0; i<mReadyEvents.size(); ++i )
+		mReadyEvents[i] = 0;
+
+#ifdef __linux__
+	if ( mEpollFileDescriptor!=-1 )
+	{
+		// Only tell epoll about the ports whose interest changed
+		for ( std::size_t i=0; i<mPorts.size(); ++i )
+		{
+			Port& port = mPorts[i];
+			unsigned int wantedEvents = getWantedEvents( port );
+			if ( wantedEvents==port.registeredEvents )
+				continue;
+			struct epoll_event event;
+			event.events = 0;
+			if ( wantedEvents & ReadEvent )
+				event.events |= EPOLLIN;
+			if ( wantedEvents & WriteEvent )
+				event.events |= EPOLLOUT;
+			event.data.u64 = i;
+			int operation = port.registeredEvents==0 ? EPOLL_CTL_ADD : ( wantedEvents==0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD );
+			if ( epoll_ctl( mEpollFileDescriptor, operation, port.fileDescriptor, &event )!=0 )
+			{
+				// The file descriptor stays registered as it was, unless epoll doesn't know it
+				if ( errno==ENOENT )
+					port.registeredEvents = 0;
+				port.error.set( DeviceError, errno );
+				continue;
+			}
+			port.registeredEvents = wantedEvents;
+		}
+
+		mEventBuffer.resize( mPorts.size() * sizeof(struct epoll_event) );
+		struct epoll_event* events = reinterpret_cast<struct epoll_event*>( &mEventBuffer[0] );
+		int numEvents = epoll_wait( mEpollFileDescriptor, events, static_cast<int>(mPorts.size()), timeoutInMs );
+		if ( numEvents==-1 )
+			return errno==EINTR;
+		for ( int i=0; i<numEvents; ++i )
+		{
+			unsigned int& readyEvents = mReadyEvents[ static_cast<std::size_t>(events[i].data.u64) ];
+			if ( events[i].events & EPOLLIN )
+				readyEvents |= ReadEvent;
+			if ( events[i].events & EPOLLOUT )
+				readyEvents |= WriteEvent;
+			if ( events[i].events & (EPOLLERR | EPOLLHUP) )
+				readyEvents |= ErrorEvent;
+		}
+		return true;
+	}
+#endif
+
+	mEventBuffer.resize( mPorts.size() * sizeof(struct pollfd) );
+	struct pollfd* pollDescriptors = reinterpret_cast<struct pollfd*>( &mEventBuffer[0] );
+	for ( std::size_t i=0; i<mPorts.size(); ++i )
+	{
+		unsigned int wantedEvents = getWantedEvents( mPorts[i] );
+		pollDescriptors[i].fd = wantedEvents ? mPorts[i].fileDescriptor : -1;		// Negative descriptors are ignored
+		pollDescriptors[i].events = static_cast<short>( ( (wantedEvents & ReadEvent) ? POLLIN : 0 ) | ( (wantedEvents & WriteEvent) ? POLLOUT : 0 ) );
+		pollDescriptors[i].revents = 0;
+	}
+	int numEvents = poll( pollDescriptors, static_cast<nfds_t>(mPorts.size()), timeoutInMs );
+	if ( numEvents==-1 )
+		return errno==EINTR;
+	for ( std::size_t i=0; i<mPorts.size(); ++i )
+	{
+		if ( pollDescriptors[i].revents & POLLIN )
+			mReadyEvents[i] |= ReadEvent;
+		if ( pollDescriptors[i].revents & POLLOUT )
+			mReadyEvents[i] |= WriteEvent;
+		if ( pollDescriptors[i].revents & (POLLERR | POLLHUP | POLLNVAL) )
+			mReadyEvents[i] |= ErrorEvent;
+	}
+	return true;
+}
+
+void MultiPortController::processEvents( Port& port, unsigned int events )
+{
+	if ( (events & WriteEvent) && port.numBytesWritten<port.output.size() )
+	{
+		ssize_t ret = write( port.fileDescriptor, &port.output[port.numBytesWritten], port.output.size() - port.numBytesWritten );
+		if ( ret>0 )
+			port.numBytesWritten += static_cast<std::size_t>(ret);
+		else if ( ret==-1 && errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR )
+			port.error.set( WriteError, errno );
+	}
+	if ( (events & (ReadEvent | ErrorEvent)) && port.numBytesRead<port.input.size() && !port.error.isError() )
+	{
+		ssize_t ret = read( port.fileDescriptor, &port.input[port.numBytesRead], port.input.size() - port.numBytesRead );
+		if ( ret>0 )
+			port.numBytesRead += static_cast<std::size_t>(ret);
+		else if ( ret==0 )
+			port.error.set( ShortReadError, 0, static_cast<unsigned int>(port.numBytesRead), static_cast<unsigned int>(port.input.size()) );
+		else if ( errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR )
+			port.error.set( ReadError, errno, static_cast<unsigned int>(port.numBytesRead), static_cast<unsigned int>(port.input.size()) );
+	}
+	else if ( (events & ErrorEvent) && !port.error.isError() )
+	{
+		port.error.set( DeviceError );
+	}
+}
+
+bool MultiPortController::decodeResponses( Port& port )
+{
+	std::size_t offset = 0;
+	for ( std::size_t i=0; i<port.queries.size(); ++i )
+	{
+		const Query& query = port.queries[i];
+		const unsigned char* response = &port.input[offset];
+		switch ( query.type )
+		{
+		case PositionQuery:
+			*query.result = Protocol::decodePosition( response );
+			offset += Protocol::GetPosition::numResponseBytes;
+			break;
+		case MovingStateQuery:
+			{
+				bool servosAreMoving = false;
+				if ( !Protocol::decodeMovingState( response, servosAreMoving ) )
+				{
+					// The responses are out of sync, drop whatever is left before the next transfer
+					port.error.set( ProtocolError, 0, 0, 0, response[0] );
+					port.discardInputBeforeWrite = true;
+					return false;
+				}
+				*query.result = servosAreMoving ? 1 : 0;
+				offset += Protocol::GetMovingState::numResponseBytes;
+			}
+			break;
+		case ErrorsQuery:
+			*query.result = Protocol::decodeErrors( response );
+			offset += Protocol::GetErrors::numResponseBytes;
+			break;
+		}
+	}
+	return true;
+}
+
+}
@@ -0,0 +1,530 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RPMRecorder.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <time.h>
+
+#include "RPMProtocol.h"
+
+#ifndef _WIN32
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+namespace RPM
+{
+
+static_assert( sizeof(Recorder::Record)==Recorder::RecordSize, "Unexpected record size" );
+static_assert( sizeof(Recorder::FileHeader)==Recorder::RecordSize, "Unexpected file header size" );
+
+static const char RecordMagic[8] = "RPMREC1";
+
+Recorder::MappedFile::MappedFile()
+	: fileDescriptor(-1),
+	  mapping(NULL),
+	  fileIndex(0),
+	  numRecordsUsed(0)
+{
+}
+
+Recorder::Recorder()
+	: mBasePath(),
+	  mMaxNumFiles(0),
+	  mNumRecordsPerFile(0),
+	  mCurrentFile(),
+	  mNumCalls(0),
+	  mNumRecords(0),
+	  mNumDroppedRecords(0),
+	  mFileMutex(),
+	  mFileCondition(),
+	  mNextFile(),
+	  mFullFile(),
+	  mNextFileIndex(0),
+	  mNextFileFailed(false),
+	  mStopRequested(false),
+	  mFileThread()
+{
+}
+
+Recorder::~Recorder()
+{
+	close();
+}
+
+bool Recorder::open( const std::string& basePath, unsigned int maxFileSizeInBytes, unsigned int maxNumFiles, std::string* errorMessage )
+{
+	close();
+	if ( basePath.empty() || maxNumFiles==0 || maxFileSizeInBytes<2*RecordSize )
+	{
+		if ( errorMessage )
+			*errorMessage = "Invalid recorder file path or size";
+		return false;
+	}
+	mBasePath = basePath;
+	mMaxNumFiles = maxNumFiles;
+	mNumRecordsPerFile = maxFileSizeInBytes / RecordSize - 1;		// The header takes one record
+	mNumCalls = 0;
+	mNumRecords = 0;
+	mNumDroppedRecords = 0;
+	if ( !mapFile( 0, mCurrentFile, errorMessage ) )
+		return false;
+
+	mNextFileIndex = 1;
+	mNextFileFailed = false;
+	mStopRequested = false;
+	mFileThread = std::thread( &Recorder::runFileThread, this );
+	return true;
+}
+
+void Recorder::close()
+{
+	if ( mFileThread.joinable() )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mFileMutex );
+			mStopRequested = true;
+			mFileCondition.notify_one();
+		}
+		mFileThread.join();
+	}
+
+	unmapFile( mFullFile );
+	unmapFile( mCurrentFile );
+	if ( mNextFile.mapping )
+	{
+		// Never recorded into
+		unsigned int fileIndex = mNextFile.fileIndex;
+		unmapFile( mNextFile );
+#ifndef _WIN32
+		unlink( getFilePath( mBasePath, fileIndex ).c_str() );
+#endif
+	}
+}
+
+std::string Recorder::getFilePath( const std::string& basePath, unsigned int fileIndex )
+{
+	char suffix[16];
+	std::snprintf( suffix, sizeof(suffix), ".%06u", fileIndex );
+	return basePath + suffix;
+}
+
+unsigned long long int Recorder::getTimestampInNs()
+{
+#ifdef _WIN32
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+#else
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return static_cast<unsigned long long int>(now.tv_sec) * 1000000000ULL + static_cast<unsigned long long int>(now.tv_nsec);
+#endif
+}
+
+Recorder::Record* Recorder::getNextRecord()
+{
+	if ( mCurrentFile.numRecordsUsed==mNumRecordsPerFile && !switchToNextFile() )
+	{
+		mNumDroppedRecords++;
+		return NULL;
+	}
+	mNumRecords++;
+	Record* records = reinterpret_cast<Record*>( mCurrentFile.mapping + RecordSize );
+	return &records[mCurrentFile.numRecordsUsed++];
+}
+
+bool Recorder::switchToNextFile()
+{
+	std::lock_guard<std::mutex> lock( mFileMutex );
+	if ( !mNextFile.mapping )
+	{
+		// Ask the file thread to try again, the records are dropped meanwhile
+		if ( mNextFileFailed )
+		{
+			mNextFileFailed = false;
+			mFileCondition.notify_one();
+		}
+		return false;
+	}
+
+	// The file thread closes the full file before preparing the next one, so mFullFile is free
+	mFullFile = mCurrentFile;
+	mCurrentFile = mNextFile;
+	mNextFile = MappedFile();
+	mFileCondition.notify_one();
+	return true;
+}
+
+void Recorder::runFileThread()
+{
+	std::unique_lock<std::mutex> lock( mFileMutex );
+	while ( !mStopRequested )
+	{
+		if ( mFullFile.mapping )
+		{
+			MappedFile fullFile = mFullFile;
+			unsigned int fileIndex = fullFile.fileIndex;
+			lock.unlock();
+			unmapFile( fullFile );
+#ifndef _WIN32
+			// Keep the last full files besides the current one
+			if ( fileIndex>=mMaxNumFiles )
+				unlink( getFilePath( mBasePath, fileIndex-mMaxNumFiles ).c_str() );
+#endif
+			lock.lock();
+			mFullFile = MappedFile();
+			continue;
+		}
+		if ( !mNextFile.mapping && !mNextFileFailed )
+		{
+			unsigned int fileIndex = mNextFileIndex;
+			lock.unlock();
+			MappedFile nextFile;
+			bool ret = mapFile( fileIndex, nextFile, NULL );
+			lock.lock();
+			if ( ret )
+			{
+				mNextFile = nextFile;
+				mNextFileIndex++;
+			}
+			else
+			{
+				mNextFileFailed = true;
+			}
+			continue;
+		}
+		mFileCondition.wait( lock );
+	}
+}
+
+void Recorder::recordWrite( unsigned long long int timestampInNs, const unsigned char* data, unsigned int dataSizeInBytes, ErrorCode errorCode )
+{
+	if ( !isOpen() )
+		return;
+	unsigned int callIndex = mNumCalls++;
+	unsigned int offset = 0;
+	while ( offset<dataSizeInBytes )
+	{
+		unsigned int frameSize = getFrameSize( data+offset, dataSizeInBytes-offset );
+		bool firstRecordOfFrame = true;
+		while ( frameSize>0 )
+		{
+			Record* record = getNextRecord();
+			if ( !record )
+				return;
+			unsigned int numBytes = frameSize<MaxNumBytesPerRecord ? frameSize : MaxNumBytesPerRecord;
+
+			// Built on the stack and copied whole, so no byte of the mapping is left unset
+			Record newRecord;
+			std::memset( &newRecord, 0, sizeof(newRecord) );
+			newRecord.timestampInNs = timestampInNs;
+			newRecord.callIndex = callIndex;
+			newRecord.callSizeInBytes = dataSizeInBytes;
+			newRecord.type = WriteRecord;
+			newRecord.flags = static_cast<unsigned char>( (numBytes<frameSize ? ContinuedFlag : 0) | (errorCode!=NoError ? FailedFlag : 0) );
+			newRecord.errorCode = static_cast<unsigned char>(errorCode);
+			newRecord.numBytes = static_cast<unsigned char>(numBytes);
+			newRecord.deviceNumber = 0xFF;
+			newRecord.channelNumber = 0xFF;
+			std::memcpy( newRecord.bytes, data+offset, numBytes );
+			if ( firstRecordOfFrame )
+				decodeFrame( newRecord );
+			*record = newRecord;
+
+			offset += numBytes;
+			frameSize -= numBytes;
+			firstRecordOfFrame = false;
+		}
+	}
+}
+
+void Recorder::recordRead( unsigned long long int timestampInNs, const unsigned char* data, unsigned int dataSizeInBytes, ErrorCode errorCode )
+{
+	if ( !isOpen() )
+		return;
+	Record* record = getNextRecord();
+	if ( !record )
+		return;
+	
+	// The responses are a few bytes long, anything beyond a record is left out
+	Record newRecord;
+	std::memset( &newRecord, 0, sizeof(newRecord) );
+	newRecord.timestampInNs = timestampInNs;
+	newRecord.callIndex = mNumCalls++;
+	newRecord.callSizeInBytes = dataSizeInBytes;
+	newRecord.type = ReadRecord;
+	newRecord.flags = static_cast<unsigned char>( errorCode!=NoError ? FailedFlag : 0 );
+	newRecord.errorCode = static_cast<unsigned char>(errorCode);
+	newRecord.deviceNumber = 0xFF;
+	newRecord.channelNumber = 0xFF;
+	if ( errorCode==NoError )
+	{
+		unsigned int numBytes = dataSizeInBytes<MaxNumBytesPerRecord ? dataSizeInBytes : MaxNumBytesPerRecord;
+		newRecord.numBytes = static_cast<unsigned char>(numBytes);
+		std::memcpy( newRecord.bytes, data, numBytes );
+		if ( numBytes==1 )
+			newRecord.value = data[0];
+		else if ( numBytes==2 )
+			newRecord.value = Protocol::decodePosition( data );
+	}
+	*record = newRecord;
+}
+
+unsigned int Recorder::getFrameSize( const unsigned char* data, unsigned int dataSizeInBytes )
+{
+	if ( dataSizeInBytes==0 )
+		return 0;
+
+	unsigned int headerSize = 0;
+	unsigned char opcode = 0;
+	if ( data[0]==Protocol::PololuStartByte )
+	{
+		if ( dataSizeInBytes<3 )
+			return dataSizeInBytes;		// The baud rate indication byte, or a truncated frame
+		headerSize = Protocol::PololuProtocol::headerSize;
+		opcode = static_cast<unsigned char>( data[2] | 0x80 );
+	}
+	else if ( data[0]==Protocol::MiniSSCStartByte )
+	{
+		return dataSizeInBytes<Protocol::MiniSSCFrameSize ? dataSizeInBytes : Protocol::MiniSSCFrameSize;
+	}
+	else if ( data[0] & 0x80 )
+	{
+		headerSize = Protocol::CompactProtocol::headerSize;
+		opcode = data[0];
+	}
+	else
+	{
+		return dataSizeInBytes;
+	}
+
+	unsigned int numDataBytes = 0;
+	switch ( opcode )
+	{
+	case Protocol::SetTarget::opcode:			numDataBytes = Protocol::SetTarget::numDataBytes; break;
+	case Protocol::SetSpeed::opcode:			numDataBytes = Protocol::SetSpeed::numDataBytes; break;
+	case Protocol::SetAcceleration::opcode:		numDataBytes = Protocol::SetAcceleration::numDataBytes; break;
+	case Protocol::GetPosition::opcode:			numDataBytes = Protocol::GetPosition::numDataBytes; break;
+	case Protocol::GetMovingState::opcode:		numDataBytes = Protocol::GetMovingState::numDataBytes; break;
+	case Protocol::GetErrors::opcode:			numDataBytes = Protocol::GetErrors::numDataBytes; break;
+	case Protocol::GoHome::opcode:				numDataBytes = Protocol::GoHome::numDataBytes; break;
+	case Protocol::SetMultipleTargets::opcode:
+		if ( dataSizeInBytes<=headerSize )
+			return dataSizeInBytes;
+		numDataBytes = 2 + 2*data[headerSize];
+		break;
+	default:
+		return dataSizeInBytes;
+	}
+	unsigned int frameSize = headerSize + numDataBytes;
+	return frameSize<dataSizeInBytes ? frameSize : dataSizeInBytes;
+}
+
+void Recorder::decodeFrame( Record& record )
+{
+	const unsigned char* data = record.bytes;
+	unsigned int size = record.numBytes;
+	if ( size==0 )
+		return;
+	if ( data[0]==Protocol::MiniSSCStartByte )
+	{
+		record.opcode = Protocol::MiniSSCStartByte;
+		if ( size>=Protocol::MiniSSCFrameSize )
+		{
+			record.channelNumber = data[1];
+			record.value = data[2];
+		}
+		return;
+	}
+	if ( data[0]==Protocol::PololuStartByte )
+	{
+		if ( size<3 )
+			return;
+		record.deviceNumber = data[1];
+		record.opcode = static_cast<unsigned char>( data[2] | 0x80 );
+		data += Protocol::PololuProtocol::headerSize;
+		size -= Protocol::PololuProtocol::headerSize;
+	}
+	else if ( data[0] & 0x80 )
+	{
+		record.opcode = data[0];
+		data += Protocol::CompactProtocol::headerSize;
+		size -= Protocol::CompactProtocol::headerSize;
+	}
+	else
+	{
+		return;
+	}
+
+	switch ( record.opcode )
+	{
+	case Protocol::SetTarget::opcode:
+	case Protocol::SetSpeed::opcode:
+	case Protocol::SetAcceleration::opcode:
+		if ( size>=3 )
+		{
+			record.channelNumber = data[0];
+			record.value = static_cast<unsigned short>( data[1] + (data[2] << 7) );
+		}
+		break;
+	case Protocol::GetPosition::opcode:
+		if ( size>=1 )
+			record.channelNumber = data[0];
+		break;
+	case Protocol::SetMultipleTargets::opcode:
+		// The first target only
+		if ( size>=4 )
+		{
+			record.channelNumber = data[1];
+			record.value = static_cast<unsigned short>( data[2] + (data[3] << 7) );
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+bool Recorder::readFile( const std::string& filePath, FileHeader& header, std::vector<Record>& records, std::string* errorMessage )
+{
+	records.clear();
+	FILE* file = std::fopen( filePath.c_str(), "rb" );
+	if ( !file )
+	{
+		if ( errorMessage )
+			*errorMessage = "Failed to open recording " + filePath;
+		return false;
+	}
+	if ( std::fread( &header, sizeof(header), 1, file )!=1 || std::memcmp( header.magic, RecordMagic, sizeof(RecordMagic) )!=0 || header.recordSize!=RecordSize )
+	{
+		std::fclose( file );
+		if ( errorMessage )
+			*errorMessage = filePath + " is not a recording";
+		return false;
+	}
+	Record record;
+	while ( std::fread( &record, sizeof(record), 1, file )==1 && record.type!=EmptyRecord )
+		records.push_back( record );
+	std::fclose( file );
+	return true;
+}
+
+#ifdef _WIN32
+
+bool Recorder::mapFile( unsigned int /*fileIndex*/, MappedFile& /*file*/, std::string* errorMessage ) const
+{
+	if ( errorMessage )
+		*errorMessage = "Recording is not supported on this platform";
+	return false;
+}
+
+void Recorder::unmapFile( MappedFile& /*file*/ ) const
+{
+}
+
+#else
+
+bool Recorder::mapFile( unsigned int fileIndex, MappedFile& file, std::string* errorMessage ) const
+{
+	std::string filePath = getFilePath( mBasePath, fileIndex );
+	int fileDescriptor = ::open( filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+	if ( fileDescriptor==-1 )
+	{
+		if ( errorMessage )
+			*errorMessage = "Failed to create recording " + filePath + ": " + std::strerror(errno);
+		return false;
+	}
+
+	// Reserve the blocks now, so a full disk can't fault a write into the mapping later
+	std::size_t fileSize = static_cast<std::size_t>(mNumRecordsPerFile+1) * RecordSize;
+#ifdef __linux__
+	int ret = posix_fallocate( fileDescriptor, 0, static_cast<off_t>(fileSize) );
+#else
+	int ret = ftruncate( fileDescriptor, static_cast<off_t>(fileSize) )==0 ? 0 : errno;
+#endif
+	if ( ret!=0 )
+	{
+		::close( fileDescriptor );
+		unlink( filePath.c_str() );
+		if ( errorMessage )
+			*errorMessage = "Failed to allocate recording " + filePath + ": " + std::strerror(ret);
+		return false;
+	}
+
+	int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+	flags |= MAP_POPULATE;		// Fault the pages in now rather than while recording
+#endif
+	void* mapping = mmap( NULL, fileSize, PROT_READ | PROT_WRITE, flags, fileDescriptor, 0 );
+	if ( mapping==MAP_FAILED )
+	{
+		::close( fileDescriptor );
+		unlink( filePath.c_str() );
+		if ( errorMessage )
+			*errorMessage = "Failed to map recording " + filePath + ": " + std::strerror(errno);
+		return false;
+	}
+
+	// Writing the pages once now spares the recording the faults of the first write to each page
+	std::memset( mapping, 0, fileSize );
+
+	FileHeader header;
+	std::memset( &header, 0, sizeof(header) );
+	std::memcpy( header.magic, RecordMagic, sizeof(RecordMagic) );
+	header.recordSize = RecordSize;
+	header.numRecords = mNumRecordsPerFile;
+	header.fileIndex = fileIndex;
+	struct timespec now;
+	clock_gettime( CLOCK_REALTIME, &now );
+	header.wallClockTimeInNs = static_cast<unsigned long long int>(now.tv_sec) * 1000000000ULL + static_cast<unsigned long long int>(now.tv_nsec);
+	header.timestampInNs = getTimestampInNs();
+	std::memcpy( mapping, &header, sizeof(header) );
+
+	file.fileDescriptor = fileDescriptor;
+	file.mapping = static_cast<unsigned char*>(mapping);
+	file.fileIndex = fileIndex;
+	file.numRecordsUsed = 0;
+	return true;
+}
+
+void Recorder::unmapFile( MappedFile& file ) const
+{
+	if ( !file.mapping )
+		return;
+	munmap( file.mapping, static_cast<std::size_t>(mNumRecordsPerFile+1) * RecordSize );
+
+	// Give the unused preallocated space back
+	if ( ftruncate( file.fileDescriptor, static_cast<off_t>(file.numRecordsUsed+1) * RecordSize )!=0 )
+	{
+		// The file keeps its size, the readers stop at the first empty record anyway
+	}
+	::close( file.fileDescriptor );
+	file = MappedFile();
+}
+
+#endif
+
+}
@@ -0,0 +1,118 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RPMRefreshPolicy.h"
+
+#include <chrono>
+
+namespace RPM
+{
+
+RefreshPolicy::RefreshPolicy( SerialInterface* serialInterface, unsigned char numChannels, bool usePololuProtocol, unsigned char deviceNumber )
+	: mSerialInterface(serialInterface),
+	  mUsePololuProtocol(usePololuProtocol),
+	  mDeviceNumber(deviceNumber),
+	  mChannelNumbers(),
+	  mPositions(numChannels, 0),
+	  mMinIntervalInMs(20),
+	  mMaxIntervalInMs(1000),
+	  mIntervalInMs(20),
+	  mNextRefreshTimeInUs(0),
+	  mRefreshForced(false),
+	  mPositionsValid(false),
+	  mServosAreMoving(false),
+	  mNumRefreshes(0),
+	  mNumPositionReads(0)
+{
+	for ( unsigned char i=0; i<numChannels; ++i )
+		mChannelNumbers.push_back( i );
+}
+
+long long int RefreshPolicy::getTimeInMicroseconds()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void RefreshPolicy::setIntervals( unsigned int minIntervalInMs, unsigned int maxIntervalInMs )
+{
+	if ( minIntervalInMs==0 )
+		minIntervalInMs = 1;
+	if ( maxIntervalInMs<minIntervalInMs )
+		maxIntervalInMs = minIntervalInMs;
+	mMinIntervalInMs = minIntervalInMs;
+	mMaxIntervalInMs = maxIntervalInMs;
+	mIntervalInMs = minIntervalInMs;
+	mNextRefreshTimeInUs = 0;
+}
+
+bool RefreshPolicy::isRefreshDue() const
+{
+	return mRefreshForced.load() || getTimeInMicroseconds()>=mNextRefreshTimeInUs;
+}
+
+bool RefreshPolicy::refresh( bool& positionsRead, unsigned int timeoutInMs )
+{
+	positionsRead = false;
+	mNumRefreshes++;
+
+	// A force requested during the queries applies to the next refresh
+	bool forced = mRefreshForced.exchange(false);
+	bool servosWereMoving = mServosAreMoving;
+	
+	bool servosAreMoving = false;
+	bool ret = mUsePololuProtocol ? 
+				mSerialInterface->getMovingStatePP( mDeviceNumber, servosAreMoving, timeoutInMs ) :
+				mSerialInterface->getMovingStateCP( servosAreMoving, timeoutInMs );
+	if ( ret )
+	{
+		mServosAreMoving = servosAreMoving;
+		if ( servosAreMoving || servosWereMoving || forced || !mPositionsValid )
+		{
+			unsigned int numChannels = static_cast<unsigned int>( mChannelNumbers.size() );
+			const unsigned char* channelNumbers = mChannelNumbers.empty() ? NULL : &mChannelNumbers[0];
+			unsigned short* positions = mPositions.empty() ? NULL : &mPositions[0];
+			ret = mUsePololuProtocol ? 
+					mSerialInterface->getPositionsPP( mDeviceNumber, channelNumbers, numChannels, positions, timeoutInMs ) :
+					mSerialInterface->getPositionsCP( channelNumbers, numChannels, positions, timeoutInMs );
+			mNumPositionReads++;
+			positionsRead = ret;
+		}
+	}
+
+	// After a failure, the positions are read again on the next refresh, which backs off 
+	// like an idle device so a disconnected one isn't polled at full rate
+	mPositionsValid = ret && ( mPositionsValid || positionsRead );
+	scheduleNextRefresh( ret && ( servosAreMoving || forced ) );
+	return ret;
+}
+
+void RefreshPolicy::scheduleNextRefresh( bool somethingHappened )
+{
+	if ( somethingHappened )
+		mIntervalInMs = mMinIntervalInMs;
+	else if ( mIntervalInMs<mMaxIntervalInMs )
+		mIntervalInMs = ( mIntervalInMs>mMaxIntervalInMs/2 ) ? mMaxIntervalInMs : mIntervalInMs*2;
+	mNextRefreshTimeInUs = getTimeInMicroseconds() + static_cast<long long int>(mIntervalInMs) * 1000;
+}
+
+}
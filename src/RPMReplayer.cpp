@@ -0,0 +1,197 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RPMReplayer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace RPM
+{
+
+static long long int getTimeInNanoseconds()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static void sleepUntil( long long int timeInNs )
+{
+	std::this_thread::sleep_until( std::chrono::steady_clock::time_point( std::chrono::duration_cast<std::chrono::steady_clock::duration>( std::chrono::nanoseconds(timeInNs) ) ) );
+}
+
+Replayer::Report::Report()
+	: numWrites(0),
+	  numReads(0),
+	  numBytesWritten(0),
+	  numBytesRead(0),
+	  numFailures(0),
+	  numMismatchedResponses(0),
+	  recordedDurationInUs(0),
+	  durationInUs(0),
+	  meanDriftInUs(0),
+	  p99DriftInUs(0),
+	  maxDriftInUs(0)
+{
+}
+
+Replayer::Replayer()
+	: mCalls(),
+	  mBytes(),
+	  mDrifts(),
+	  mResponse(),
+	  mStopRequested(false)
+{
+}
+
+bool Replayer::loadFile( const std::string& filePath, std::string* errorMessage )
+{
+	Recorder::FileHeader header;
+	std::vector<Recorder::Record> records;
+	if ( !Recorder::readFile( filePath, header, records, errorMessage ) )
+		return false;
+
+	for ( std::size_t i=0; i<records.size(); ++i )
+	{
+		const Recorder::Record& record = records[i];
+		bool isWrite = record.type==Recorder::WriteRecord;
+
+		// The frames of a write are in consecutive records, possibly across files
+		if ( isWrite && !mCalls.empty() && mCalls.back().isWrite && mCalls.back().callIndex==record.callIndex )
+		{
+			mBytes.insert( mBytes.end(), record.bytes, record.bytes + record.numBytes );
+			mCalls.back().numBytes += record.numBytes;
+			continue;
+		}
+
+		Call call;
+		call.timestampInNs = record.timestampInNs;
+		call.callIndex = record.callIndex;
+		call.isWrite = isWrite;
+		call.failed = !isWrite && (record.flags & Recorder::FailedFlag)!=0;
+		call.offset = mBytes.size();
+		call.numBytes = record.numBytes;
+		call.callSizeInBytes = record.callSizeInBytes;
+		mBytes.insert( mBytes.end(), record.bytes, record.bytes + record.numBytes );
+		mCalls.push_back( call );
+	}
+	return true;
+}
+
+void Replayer::clear()
+{
+	mCalls.clear();
+	mBytes.clear();
+}
+
+unsigned long long int Replayer::getRecordedDurationInUs() const
+{
+	if ( mCalls.empty() )
+		return 0;
+	return ( mCalls.back().timestampInNs - mCalls.front().timestampInNs ) / 1000;
+}
+
+bool Replayer::replay( SerialInterface* serialInterface, TimingMode timingMode, double speed, Report* report, unsigned int timeoutInMs )
+{
+	Report localReport;
+	Report& result = report ? *report : localReport;
+	result = Report();
+	if ( !serialInterface || (timingMode==ScaledTiming && speed<=0) )
+		return false;
+	if ( timingMode==OriginalTiming )
+		speed = 1.0;
+
+	mStopRequested.store( false );
+	mDrifts.clear();
+	mDrifts.reserve( mCalls.size() );
+	result.recordedDurationInUs = getRecordedDurationInUs();
+
+	bool ret = true;
+	long long int startTime = getTimeInNanoseconds();
+	for ( std::size_t i=0; i<mCalls.size(); ++i )
+	{
+		if ( mStopRequested.load() )
+		{
+			ret = false;
+			break;
+		}
+
+		const Call& call = mCalls[i];
+		if ( call.isWrite )
+		{
+			if ( timingMode!=FastestTiming )
+			{
+				long long int scheduledTime = startTime + static_cast<long long int>( static_cast<double>(call.timestampInNs - mCalls[0].timestampInNs) / speed );
+				sleepUntil( scheduledTime );
+				mDrifts.push_back( getTimeInNanoseconds() - scheduledTime );
+			}
+			result.numWrites++;
+			if ( serialInterface->writeBytes( &mBytes[call.offset], call.numBytes ) )
+				result.numBytesWritten += call.numBytes;
+			else
+			{
+				result.numFailures++;
+				ret = false;
+			}
+		}
+		else
+		{
+			// Only the first bytes of a long response were recorded
+			result.numReads++;
+			mResponse.resize( call.callSizeInBytes );
+			if ( call.callSizeInBytes==0 )
+				continue;
+			bool readOk = serialInterface->readBytes( &mResponse[0], call.callSizeInBytes, timeoutInMs );
+			if ( readOk )
+			{
+				result.numBytesRead += call.callSizeInBytes;
+				
+				// A read that failed at recording time has no response to compare with, but the 
+				// target may answer it now: reading it keeps the following responses aligned
+				if ( !call.failed && std::memcmp( &mResponse[0], &mBytes[call.offset], call.numBytes )!=0 )
+					result.numMismatchedResponses++;
+			}
+			else if ( !call.failed )
+			{
+				result.numFailures++;
+				ret = false;
+			}
+		}
+	}
+	result.durationInUs = static_cast<unsigned long long int>( getTimeInNanoseconds() - startTime ) / 1000;
+
+	if ( !mDrifts.empty() )
+	{
+		std::sort( mDrifts.begin(), mDrifts.end() );
+		long long int totalDrift = 0;
+		for ( std::size_t i=0; i<mDrifts.size(); ++i )
+			totalDrift += mDrifts[i];
+		result.meanDriftInUs = static_cast<unsigned long long int>( totalDrift / static_cast<long long int>(mDrifts.size()) ) / 1000;
+		result.p99DriftInUs = static_cast<unsigned long long int>( mDrifts[ (mDrifts.size()-1) * 99 / 100 ] ) / 1000;
+		result.maxDriftInUs = static_cast<unsigned long long int>( mDrifts.back() ) / 1000;
+	}
+	return ret;
+}
+
+}
@@ -23,23 +23,33 @@
 */
 #include "RPMSerialInterface.h"
 
+#include <chrono>
+
+#include "RPMRecorder.h"
+
 #ifdef _WIN32
-	#include "RPMSerialInterfaceWindows.h"
+	#include "RPMTransportWindows.h"
 #else
-	#include "RPMSerialInterfacePOSIX.h"
+	#include "RPMTransportPOSIX.h"
 #endif
 
 namespace RPM
 {
 
+static long long int getTimeInNanoseconds()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
 SerialInterface* SerialInterface::createSerialInterface( const std::string& portName, unsigned int baudRate, std::string* errorMessage )
 {
-	SerialInterface* serialInterface = NULL;
+	Transport* transport = NULL;
 #ifdef _WIN32
-	serialInterface = new SerialInterfaceWindows( portName, baudRate, errorMessage );
+	transport = new TransportWindows( portName, baudRate, errorMessage );
 #else
-	serialInterface = new SerialInterfacePOSIX( portName, errorMessage );
+	transport = new TransportPOSIX( portName, baudRate, errorMessage );
 #endif
+	SerialInterface* serialInterface = new SerialInterface( transport );
 
 	// If the interface couldn't be open properly, delete it
 	if ( !serialInterface->isOpen() )
@@ -51,220 +61,439 @@ SerialInterface* SerialInterface::createSerialInterface( const std::string& port
 	return serialInterface;
 }
 
-SerialInterface::SerialInterface()
-	: mErrorMessage()
+SerialInterface::SerialInterface( Transport* transport )
+	: mTransport(transport),
+	  mRecorder(NULL),
+	  mError(),
+	  mStatistics(),
+	  mLastWriteTimeInNs(0),
+	  mReadTimeoutInMs(1000),
+	  mBatchDepth(0),
+	  mBatchBuffer(),
+	  mResponseBuffer()
 {
+	mBatchBuffer.reserve(256);
+	mResponseBuffer.reserve(64);
 }
 
 SerialInterface::~SerialInterface()
 {
+	if ( isOpen() )
+	{
+		// Before destroying the interface, we send the pending batched commands and "go home"
+		while ( isBatching() )
+			endBatch();
+		goHomeCP();
+	}
+	delete mTransport;
+	mTransport = NULL;
 }
 
-void SerialInterface::clearErrorMessage()
+void SerialInterface::beginBatch()
 {
-	mErrorMessage.clear();
+	mBatchDepth++;
 }
 
-void SerialInterface::setErrorMessage( const std::string& message )
+bool SerialInterface::endBatch()
 {
-	mErrorMessage = message;
+	if ( mBatchDepth==0 )
+		return true;
+	mBatchDepth--;
+	if ( mBatchDepth>0 )
+		return true;
+	return flushBatch();
 }
 
-bool SerialInterface::setTargetCP( unsigned char channelNumber, unsigned short target )
+bool SerialInterface::flushBatch()
 {
-	clearErrorMessage();
-	if ( target<getMinChannelValue() || target>getMaxChannelValue() )
+	if ( mBatchBuffer.empty() )
+		return true;
+	
+	// The buffer is cleared even if the write fails, the commands are not retried
+	bool ret = writeBytes( &mBatchBuffer[0], static_cast<unsigned int>(mBatchBuffer.size()) );
+	mBatchBuffer.clear();
+	return ret;
+}
+
+bool SerialInterface::writeBytes( const unsigned char* data, unsigned int dataSizeInBytes )
+{
+	if ( !mTransport )
+	{
+		setError( PortClosedError );
+		return false;
+	}
+	unsigned long long int timestampInNs = mRecorder ? Recorder::getTimestampInNs() : 0;
+	mLastWriteTimeInNs = getTimeInNanoseconds();
+	bool ret = mTransport->writeBytes( data, dataSizeInBytes );
+	if ( ret )
+		mStatistics.addWrite( dataSizeInBytes, getTimeInNanoseconds() - mLastWriteTimeInNs );
+	else
+	{
+		mError = mTransport->getError();
+		mStatistics.addFailure( mError.getCode() );
+	}
+	if ( mRecorder )
+		mRecorder->recordWrite( timestampInNs, data, dataSizeInBytes, ret ? NoError : mError.getCode() );
+	return ret;
+}
+
+bool SerialInterface::readBytes( unsigned char* data, unsigned int dataSizeInBytes, unsigned int timeoutInMs )
+{
+	if ( timeoutInMs==DefaultReadTimeout )
+		timeoutInMs = mReadTimeoutInMs;
+	if ( !mTransport )
+	{
+		setError( PortClosedError );
 		return false;
+	}
+	unsigned long long int timestampInNs = mRecorder ? Recorder::getTimestampInNs() : 0;
+	bool ret = mTransport->readBytes( data, dataSizeInBytes, timeoutInMs );
+	if ( ret )
+	{
+		mStatistics.addRead( dataSizeInBytes );
+		mStatistics.addRoundTrip( getTimeInNanoseconds() - mLastWriteTimeInNs );
+	}
+	else
+	{
+		mError = mTransport->getError();
+		mStatistics.addFailure( mError.getCode() );
+	}
+	if ( mRecorder )
+		mRecorder->recordRead( timestampInNs, data, dataSizeInBytes, ret ? NoError : mError.getCode() );
+	return ret;
+}
 
-	unsigned char command[4] = { 0x84, channelNumber, target & 0x7F, (target >> 7) & 0x7F };
-	if ( !writeBytes( command, sizeof(command) ) )
+bool SerialInterface::sendBytes( const unsigned char* data, unsigned int dataSizeInBytes )
+{
+	if ( !isBatching() )
+		return writeBytes( data, dataSizeInBytes );
+	
+	if ( !isOpen() )
+	{
+		setError( PortClosedError );
 		return false;
+	}
+	mBatchBuffer.insert( mBatchBuffer.end(), data, data+dataSizeInBytes );
 	return true;
 }
-	
-bool SerialInterface::setTargetPP( unsigned char deviceNumber, unsigned char channelNumber, unsigned short target )
+
+bool SerialInterface::receiveBytes( unsigned char* data, unsigned int dataSizeInBytes, unsigned int timeoutInMs )
 {
-	clearErrorMessage();
-	if ( target<getMinChannelValue() || target>getMaxChannelValue() )
+	// The request for this response might still be sitting in the batch buffer
+	if ( !flushBatch() )
 		return false;
-	unsigned char command[6] = { 0xAA, deviceNumber, 0x84 & 0x7F, channelNumber, target & 0x7F, (target >> 7) & 0x7F };
-	if ( !writeBytes( command, sizeof(command) ) )
+	return readBytes( data, dataSizeInBytes, timeoutInMs );
+}
+
+bool SerialInterface::sendFrame( const unsigned char* frame, unsigned int frameSizeInBytes )
+{
+	clearError();
+	mStatistics.addFrame( frame, frameSizeInBytes );
+	return sendBytes( frame, frameSizeInBytes );
+}
+
+bool SerialInterface::checkValidTargetValue( unsigned short target )
+{
+	if ( target<getMinChannelValue() || target>getMaxChannelValue() )
+	{
+		setError( InvalidArgumentError, target );
 		return false;
+	}
 	return true;
 }
 
+bool SerialInterface::setTargetCP( unsigned char channelNumber, unsigned short target )
+{
+	clearError();
+	if ( !checkValidTargetValue(target) )
+		return false;
+	return sendCommand<Protocol::CompactProtocol, Protocol::SetTarget>( 0, channelNumber, target );
+}
+	
+bool SerialInterface::setTargetPP( unsigned char deviceNumber, unsigned char channelNumber, unsigned short target )
+{
+	clearError();
+	if ( !checkValidTargetValue(target) )
+		return false;
+	return sendCommand<Protocol::PololuProtocol, Protocol::SetTarget>( deviceNumber, channelNumber, target );
+}
+
 bool SerialInterface::setTargetMSSCP( unsigned char miniSCCChannelNumber, unsigned char normalizedTarget )
 {
-	clearErrorMessage();
+	clearError();
 	if ( normalizedTarget>254 )
+	{
+		setError( InvalidArgumentError, normalizedTarget );
 		return false;
-	unsigned char command[3] = { 0xFF, miniSCCChannelNumber, normalizedTarget };
-	if ( !writeBytes( command, sizeof(command) ) )
+	}
+	unsigned char frame[Protocol::MiniSSCFrameSize];
+	mStatistics.addCommand( Protocol::MiniSSCStartByte );
+	return sendBytes( frame, Protocol::encodeMiniSSCSetTarget( frame, miniSCCChannelNumber, normalizedTarget ) );
+}
+
+bool SerialInterface::setMultipleTargetsCP( unsigned char firstChannelNumber, unsigned char numTargets, const unsigned short* targets )
+{
+	clearError();
+	return setMultipleTargets( false, 0, firstChannelNumber, numTargets, targets );
+}
+
+bool SerialInterface::setMultipleTargetsPP( unsigned char deviceNumber, unsigned char firstChannelNumber, unsigned char numTargets, const unsigned short* targets )
+{
+	clearError();
+	return setMultipleTargets( true, deviceNumber, firstChannelNumber, numTargets, targets );
+}
+
+bool SerialInterface::setMultipleTargets( bool usePololuProtocol, unsigned char deviceNumber, unsigned char firstChannelNumber, unsigned char numTargets, const unsigned short* targets )
+{
+	if ( numTargets==0 || numTargets>Protocol::SetMultipleTargets::maxNumTargets || !targets )
+	{
+		setError( InvalidArgumentError, numTargets );
 		return false;
-	return true;
+	}
+	for ( unsigned char i=0; i<numTargets; ++i )
+	{
+		if ( !checkValidTargetValue(targets[i]) )
+			return false;
+	}
+
+	unsigned char frame[Protocol::PololuProtocol::headerSize + 2 + 2*Protocol::SetMultipleTargets::maxNumTargets];
+	unsigned int size = 0;
+	if ( usePololuProtocol )
+		size = Protocol::encodeSetMultipleTargets<Protocol::PololuProtocol>( frame, deviceNumber, firstChannelNumber, numTargets, targets );
+	else
+		size = Protocol::encodeSetMultipleTargets<Protocol::CompactProtocol>( frame, deviceNumber, firstChannelNumber, numTargets, targets );
+	mStatistics.addCommand( Protocol::SetMultipleTargets::opcode );
+	return sendBytes( frame, size );
+}
+
+bool SerialInterface::setTargetsCP( const std::map<unsigned char, unsigned short>& targets )
+{
+	clearError();
+	return setTargets( false, 0, targets );
+}
+
+bool SerialInterface::setTargetsPP( unsigned char deviceNumber, const std::map<unsigned char, unsigned short>& targets )
+{
+	clearError();
+	return setTargets( true, deviceNumber, targets );
+}
+
+bool SerialInterface::setTargets( bool usePololuProtocol, unsigned char deviceNumber, const std::map<unsigned char, unsigned short>& targets )
+{
+	std::map<unsigned char, unsigned short>::const_iterator itr;
+	for ( itr=targets.begin(); itr!=targets.end(); ++itr )
+	{
+		if ( !checkValidTargetValue(itr->second) )
+			return false;
+	}
+	
+	// The map is sorted by channel number, so a run ends as soon as the next channel isn't the 
+	// successor of the previous one (or the run reaches the maximum size of a command)
+	beginBatch();
+	bool ret = true;
+	unsigned short runTargets[Protocol::SetMultipleTargets::maxNumTargets];
+	unsigned char runFirstChannelNumber = 0;
+	unsigned char runSize = 0;
+	itr = targets.begin();
+	while ( ret )
+	{
+		bool endOfMap = ( itr==targets.end() );
+		if ( !endOfMap && runSize>0 && runSize<Protocol::SetMultipleTargets::maxNumTargets && itr->first==runFirstChannelNumber+runSize )
+		{
+			runTargets[runSize++] = itr->second;
+			++itr;
+			continue;
+		}
+		
+		if ( runSize==1 )
+		{
+			if ( usePololuProtocol )
+				ret = sendCommand<Protocol::PololuProtocol, Protocol::SetTarget>( deviceNumber, runFirstChannelNumber, runTargets[0] );
+			else
+				ret = sendCommand<Protocol::CompactProtocol, Protocol::SetTarget>( deviceNumber, runFirstChannelNumber, runTargets[0] );
+		}
+		else if ( runSize>1 )
+		{
+			ret = setMultipleTargets( usePololuProtocol, deviceNumber, runFirstChannelNumber, runSize, runTargets );
+		}
+		
+		if ( endOfMap )
+			break;
+
+		// Start a new run with the current channel
+		runFirstChannelNumber = itr->first;
+		runTargets[0] = itr->second;
+		runSize = 1;
+		++itr;
+	}
+	
+	if ( !endBatch() )
+		ret = false;
+	return ret;
 }
 
 bool SerialInterface::setSpeedCP( unsigned char channelNumber, unsigned short speed )
 {
-	clearErrorMessage();
-	unsigned char command[4] = { 0x87, channelNumber, speed & 0x7F, (speed >> 7) & 0x7F };
-	if ( !writeBytes( command, sizeof(command) ) )
-		return false;
-	return true;
+	clearError();
+	return sendCommand<Protocol::CompactProtocol, Protocol::SetSpeed>( 0, channelNumber, speed );
 }
 
 bool SerialInterface::setSpeedPP( unsigned char deviceNumber, unsigned char channelNumber, unsigned short speed )
 {
-	clearErrorMessage();
-	unsigned char command[6] = { 0xAA, deviceNumber, 0x87 & 0x7F, channelNumber, speed & 0x7F, (speed >> 7) & 0x7F };
-	if ( !writeBytes( command, sizeof(command) ) )
-		return false;
-	return true;
+	clearError();
+	return sendCommand<Protocol::PololuProtocol, Protocol::SetSpeed>( deviceNumber, channelNumber, speed );
 }
 
 bool SerialInterface::setAccelerationCP( unsigned char channelNumber, unsigned char acceleration )
 {
-	clearErrorMessage();
-	unsigned short accelerationAsShort = acceleration;
-	unsigned char command[4] = { 0x89, channelNumber, accelerationAsShort & 0x7F, (accelerationAsShort >> 7) & 0x7F };
-	if ( !writeBytes( command, sizeof(command) ) )
-		return false;
-	return true;
+	clearError();
+	return sendCommand<Protocol::CompactProtocol, Protocol::SetAcceleration>( 0, channelNumber, acceleration );
 }
 
 bool SerialInterface::setAccelerationPP( unsigned char deviceNumber, unsigned char channelNumber, unsigned char acceleration )
 {
-	clearErrorMessage();
-	unsigned short accelerationAsShort = acceleration;
-	unsigned char command[6] = { 0xAA, deviceNumber, 0x89 & 0x7F, channelNumber, accelerationAsShort & 0x7F, (accelerationAsShort >> 7) & 0x7F };
-	if ( !writeBytes( command, sizeof(command) ) )
-		return false;
-	return true;
+	clearError();
+	return sendCommand<Protocol::PololuProtocol, Protocol::SetAcceleration>( deviceNumber, channelNumber, acceleration );
 }
 
-bool SerialInterface::getPositionCP( unsigned char channelNumber, unsigned short& position )
+bool SerialInterface::getPositionCP( unsigned char channelNumber, unsigned short& position, unsigned int timeoutInMs )
 {
-	clearErrorMessage();
-	
+	clearError();
 	position = 0;
-
-	unsigned char command[2] = { 0x90, channelNumber };
-	if ( !writeBytes( command, sizeof(command) ) )
+	unsigned char response[Protocol::GetPosition::numResponseBytes];
+	if ( !sendQuery<Protocol::CompactProtocol, Protocol::GetPosition>( 0, channelNumber, response, timeoutInMs ) )
 		return false;
-
-	unsigned char response[2] = { 0x00, 0x00 };
-	if ( !readBytes( response, sizeof(response) ) )
-		return false;
-
-	position = response[0] + 256*response[1];
+	position = Protocol::decodePosition( response );
 	return true;
 }
 
-bool SerialInterface::getPositionPP( unsigned char deviceNumber, unsigned char channelNumber, unsigned short& position )
+bool SerialInterface::getPositionPP( unsigned char deviceNumber, unsigned char channelNumber, unsigned short& position, unsigned int timeoutInMs )
 {
-	clearErrorMessage();
-	
+	clearError();
 	position = 0;
-
-	unsigned char command[4] = { 0xAA, deviceNumber, 0x90 & 0x7F, channelNumber };
-	if ( !writeBytes( command, sizeof(command) ) )
+	unsigned char response[Protocol::GetPosition::numResponseBytes];
+	if ( !sendQuery<Protocol::PololuProtocol, Protocol::GetPosition>( deviceNumber, channelNumber, response, timeoutInMs ) )
 		return false;
+	position = Protocol::decodePosition( response );
+	return true;
+}
 
-	unsigned char response[2] = { 0x00, 0x00 };
-	if ( !readBytes( response, sizeof(response) ) )
-		return false;
+bool SerialInterface::getPositionsCP( const unsigned char* channelNumbers, unsigned int numChannels, unsigned short* positions, unsigned int timeoutInMs )
+{
+	clearError();
+	return getPositions( false, 0, channelNumbers, numChannels, positions, timeoutInMs );
+}
 
-	position = response[0] + 256*response[1];
-	return true;
+bool SerialInterface::getPositionsPP( unsigned char deviceNumber, const unsigned char* channelNumbers, unsigned int numChannels, unsigned short* positions, unsigned int timeoutInMs )
+{
+	clearError();
+	return getPositions( true, deviceNumber, channelNumbers, numChannels, positions, timeoutInMs );
 }
 
-bool SerialInterface::getMovingStateCP( bool& servosAreMoving )
+bool SerialInterface::getPositions( bool usePololuProtocol, unsigned char deviceNumber, const unsigned char* channelNumbers, unsigned int numChannels, unsigned short* positions, unsigned int timeoutInMs )
 {
-	clearErrorMessage();
-	
-	servosAreMoving = false;
-	unsigned char command = 0x93;
-	if ( !writeBytes( &command, sizeof(command) ) )
+	if ( numChannels==0 )
+		return true;
+	if ( !channelNumbers || !positions )
+	{
+		setError( InvalidArgumentError );
 		return false;
+	}
 
-	unsigned char response = 0x00;
-	if ( !readBytes( &response, sizeof(response) ) )
+	for ( unsigned int i=0; i<numChannels; ++i )
+		positions[i] = 0;
+
+	// Queue all the requests so they go out in a single write
+	beginBatch();
+	bool ret = true;
+	for ( unsigned int i=0; i<numChannels && ret; ++i )
+	{
+		if ( usePololuProtocol )
+			ret = sendCommand<Protocol::PololuProtocol, Protocol::GetPosition>( deviceNumber, channelNumbers[i] );
+		else
+			ret = sendCommand<Protocol::CompactProtocol, Protocol::GetPosition>( deviceNumber, channelNumbers[i] );
+	}
+	if ( !endBatch() || !ret )
 		return false;
 
-	if ( response!=0x00 && response!=0x01 )
+	// The device answers the requests in order
+	const unsigned int responseSize = Protocol::GetPosition::numResponseBytes;
+	mResponseBuffer.resize( numChannels*responseSize );
+	if ( !receiveBytes( &mResponseBuffer[0], numChannels*responseSize, timeoutInMs ) )
 		return false;
 
-	servosAreMoving = (response==0x01);
+	for ( unsigned int i=0; i<numChannels; ++i )
+		positions[i] = Protocol::decodePosition( &mResponseBuffer[i*responseSize] );
 	return true;
 }
 
-bool SerialInterface::getMovingStatePP( unsigned char deviceNumber, bool& servosAreMoving )
+bool SerialInterface::getMovingStateCP( bool& servosAreMoving, unsigned int timeoutInMs )
 {
-	clearErrorMessage();
-	
+	clearError();
 	servosAreMoving = false;
-	unsigned char command[3] = { 0xAA, deviceNumber, 0x93 & 0x7F };
-	if ( !writeBytes( command, sizeof(command) ) )
+	unsigned char response[Protocol::GetMovingState::numResponseBytes];
+	if ( !sendQuery<Protocol::CompactProtocol, Protocol::GetMovingState>( 0, 0, response, timeoutInMs ) )
 		return false;
-
-	unsigned char response = 0x00;
-	if ( !readBytes( &response, sizeof(response) ) )
+	if ( !Protocol::decodeMovingState( response, servosAreMoving ) )
+	{
+		setError( ProtocolError, response[0] );
 		return false;
-
-	servosAreMoving = (response==0x01);
+	}
 	return true;
 }
 
-bool SerialInterface::getErrorsCP( unsigned short& errors )
+bool SerialInterface::getMovingStatePP( unsigned char deviceNumber, bool& servosAreMoving, unsigned int timeoutInMs )
 {
-	clearErrorMessage();
-	
-	unsigned char command = 0xA1;
-	if ( !writeBytes( &command, sizeof(command) ) )
+	clearError();
+	servosAreMoving = false;
+	unsigned char response[Protocol::GetMovingState::numResponseBytes];
+	if ( !sendQuery<Protocol::PololuProtocol, Protocol::GetMovingState>( deviceNumber, 0, response, timeoutInMs ) )
 		return false;
-
-	unsigned char response[2] = { 0x00, 0x00 };
-	if ( !readBytes( response, sizeof(response) ) )
+	if ( !Protocol::decodeMovingState( response, servosAreMoving ) )
+	{
+		setError( ProtocolError, response[0] );
 		return false;
-
-	errors = (response[0] & 0x7F) + 256 * (response[1] & 0x7F);	// Need to check this code on real errors!
+	}
 	return true;
 }
 
-bool SerialInterface::getErrorsPP( unsigned char deviceNumber, unsigned short& errors )
+bool SerialInterface::getErrorsCP( unsigned short& errors, unsigned int timeoutInMs )
 {
-	clearErrorMessage();
-	
-	unsigned char command[3] = { 0xAA, deviceNumber, 0xA1 & 0x7F };
-	if ( !writeBytes( command, sizeof(command) ) )
+	clearError();
+	unsigned char response[Protocol::GetErrors::numResponseBytes];
+	if ( !sendQuery<Protocol::CompactProtocol, Protocol::GetErrors>( 0, 0, response, timeoutInMs ) )
 		return false;
+	errors = Protocol::decodeErrors( response );	// Need to check this code on real errors!
+	return true;
+}
 
-	unsigned char response[2] = { 0x00, 0x00 };
-	if ( !readBytes( response, sizeof(response) ) )
+bool SerialInterface::getErrorsPP( unsigned char deviceNumber, unsigned short& errors, unsigned int timeoutInMs )
+{
+	clearError();
+	unsigned char response[Protocol::GetErrors::numResponseBytes];
+	if ( !sendQuery<Protocol::PololuProtocol, Protocol::GetErrors>( deviceNumber, 0, response, timeoutInMs ) )
 		return false;
-
-	errors = (response[0] & 0x7F) + 256 * (response[1] & 0x7F);	// Need to check this code on real errors!
+	errors = Protocol::decodeErrors( response );	// Need to check this code on real errors!
 	return true;
 }
 
 bool SerialInterface::goHomeCP()
 {
-	clearErrorMessage();
-	
-	unsigned char command = 0xA2;
-	if ( !writeBytes( &command, sizeof(command) ) )
-		return false;
-	return true;
+	clearError();
+	return sendCommand<Protocol::CompactProtocol, Protocol::GoHome>( 0 );
 }
 
 bool SerialInterface::goHomePP( unsigned char deviceNumber )
 {
-	clearErrorMessage();
-	
-	unsigned char command[3] = { 0xAA, deviceNumber, 0xA2 & 0x7F };
-	if ( !writeBytes( command, sizeof(command) ) )
-		return false;
-	return true;
+	clearError();
+	return sendCommand<Protocol::PololuProtocol, Protocol::GoHome>( deviceNumber );
+}
+
+bool SerialInterface::sendBaudRateIndication()
+{
+	clearError();
+	unsigned char command = Protocol::PololuStartByte;
+	return sendBytes( &command, sizeof(command) );
 }
 
-};
\ No newline at end of file
+};
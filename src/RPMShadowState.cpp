@@ -0,0 +1,296 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RPMShadowState.h"
+
+#include <chrono>
+
+#include "RPMProtocol.h"
+
+namespace RPM
+{
+
+ShadowState::Channel::Channel()
+	: target(0),
+	  sentTarget(0),
+	  speed(0),
+	  sentSpeed(0),
+	  acceleration(0),
+	  sentAcceleration(0),
+	  flags(0),
+	  deadband(0),
+	  holdTimeInMs(0),
+	  targetSentTimeInUs(0)
+{
+}
+
+ShadowState::ShadowState( SerialInterface* serialInterface, unsigned char numChannels, bool usePololuProtocol, unsigned char deviceNumber )
+	: mSerialInterface(serialInterface),
+	  mUsePololuProtocol(usePololuProtocol),
+	  mDeviceNumber(deviceNumber),
+	  mUseMultipleTargets(false),
+	  mChannels(numChannels),
+	  mRunTargets(),
+	  mNumCommandsSent(0),
+	  mNumCommandsSuppressed(0)
+{
+	mRunTargets.reserve( numChannels );
+}
+
+long long int ShadowState::getTimeInMicroseconds()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+bool ShadowState::setTargetDeadband( unsigned char channelNumber, unsigned short deadband, unsigned int holdTimeInMs )
+{
+	if ( channelNumber>=mChannels.size() )
+		return false;
+	mChannels[channelNumber].deadband = deadband;
+	mChannels[channelNumber].holdTimeInMs = holdTimeInMs;
+	return true;
+}
+
+void ShadowState::setTargetDeadband( unsigned short deadband, unsigned int holdTimeInMs )
+{
+	for ( std::size_t i=0; i<mChannels.size(); ++i )
+	{
+		mChannels[i].deadband = deadband;
+		mChannels[i].holdTimeInMs = holdTimeInMs;
+	}
+}
+
+bool ShadowState::setTarget( unsigned char channelNumber, unsigned short target )
+{
+	if ( channelNumber>=mChannels.size() )
+		return false;
+	if ( target<SerialInterface::getMinChannelValue() || target>SerialInterface::getMaxChannelValue() )
+		return false;
+	
+	Channel& channel = mChannels[channelNumber];
+	channel.target = target;
+	channel.flags &= ~(TargetDirty | TargetHeld);
+	if ( !(channel.flags & TargetSent) )
+	{
+		channel.flags |= TargetDirty;
+		return true;
+	}
+
+	unsigned short difference = target>channel.sentTarget ? target-channel.sentTarget : channel.sentTarget-target;
+	if ( difference>channel.deadband )
+		channel.flags |= TargetDirty;
+	else if ( difference>0 )
+		channel.flags |= TargetHeld;
+	else
+		mNumCommandsSuppressed++;
+	return true;
+}
+
+bool ShadowState::setSpeed( unsigned char channelNumber, unsigned short speed )
+{
+	if ( channelNumber>=mChannels.size() )
+		return false;
+
+	Channel& channel = mChannels[channelNumber];
+	channel.speed = speed;
+	if ( (channel.flags & SpeedSent) && channel.sentSpeed==speed )
+	{
+		channel.flags &= ~SpeedDirty;
+		mNumCommandsSuppressed++;
+	}
+	else
+		channel.flags |= SpeedDirty;
+	return true;
+}
+
+bool ShadowState::setAcceleration( unsigned char channelNumber, unsigned char acceleration )
+{
+	if ( channelNumber>=mChannels.size() )
+		return false;
+
+	Channel& channel = mChannels[channelNumber];
+	channel.acceleration = acceleration;
+	if ( (channel.flags & AccelerationSent) && channel.sentAcceleration==acceleration )
+	{
+		channel.flags &= ~AccelerationDirty;
+		mNumCommandsSuppressed++;
+	}
+	else
+		channel.flags |= AccelerationDirty;
+	return true;
+}
+
+bool ShadowState::isDirty() const
+{
+	for ( std::size_t i=0; i<mChannels.size(); ++i )
+	{
+		if ( mChannels[i].flags & (TargetDirty | SpeedDirty | AccelerationDirty) )
+			return true;
+	}
+	return false;
+}
+
+void ShadowState::invalidate()
+{
+	// The values never set stay clean: there's nothing to restore on the device
+	for ( std::size_t i=0; i<mChannels.size(); ++i )
+	{
+		Channel& channel = mChannels[i];
+		if ( channel.flags & TargetSent )
+			channel.flags |= TargetDirty;
+		if ( channel.flags & SpeedSent )
+			channel.flags |= SpeedDirty;
+		if ( channel.flags & AccelerationSent )
+			channel.flags |= AccelerationDirty;
+		channel.flags &= ~(TargetSent | SpeedSent | AccelerationSent);
+	}
+}
+
+bool ShadowState::flush()
+{
+	if ( !mSerialInterface )
+		return false;
+
+	// The held targets are released once their hold time has passed
+	long long int now = getTimeInMicroseconds();
+	for ( std::size_t i=0; i<mChannels.size(); ++i )
+	{
+		Channel& channel = mChannels[i];
+		if ( (channel.flags & TargetHeld) && now - channel.targetSentTimeInUs >= static_cast<long long int>(channel.holdTimeInMs)*1000 )
+			channel.flags = (channel.flags & ~TargetHeld) | TargetDirty;
+	}
+
+	unsigned int numCommands = 0;
+	for ( std::size_t i=0; i<mChannels.size(); ++i )
+	{
+		unsigned char flags = mChannels[i].flags;
+		numCommands += ((flags & TargetDirty)!=0) + ((flags & SpeedDirty)!=0) + ((flags & AccelerationDirty)!=0);
+	}
+	if ( numCommands==0 )
+		return true;
+
+	// The speed and acceleration go first so a new target is reached the way they say
+	mSerialInterface->beginBatch();
+	bool ret = true;
+	for ( std::size_t i=0; i<mChannels.size() && ret; ++i )
+	{
+		const Channel& channel = mChannels[i];
+		unsigned char channelNumber = static_cast<unsigned char>(i);
+		if ( channel.flags & SpeedDirty )
+		{
+			if ( mUsePololuProtocol )
+				ret = mSerialInterface->setSpeedPP( mDeviceNumber, channelNumber, channel.speed );
+			else
+				ret = mSerialInterface->setSpeedCP( channelNumber, channel.speed );
+		}
+		if ( ret && (channel.flags & AccelerationDirty) )
+		{
+			if ( mUsePololuProtocol )
+				ret = mSerialInterface->setAccelerationPP( mDeviceNumber, channelNumber, channel.acceleration );
+			else
+				ret = mSerialInterface->setAccelerationCP( channelNumber, channel.acceleration );
+		}
+	}
+	if ( ret )
+		ret = sendTargets();
+	if ( !mSerialInterface->endBatch() )
+		ret = false;
+	if ( !ret )
+		return false;
+
+	// Only now the device has the values
+	for ( std::size_t i=0; i<mChannels.size(); ++i )
+	{
+		Channel& channel = mChannels[i];
+		if ( channel.flags & TargetDirty )
+		{
+			channel.sentTarget = channel.target;
+			channel.targetSentTimeInUs = now;
+			channel.flags |= TargetSent;
+		}
+		if ( channel.flags & SpeedDirty )
+		{
+			channel.sentSpeed = channel.speed;
+			channel.flags |= SpeedSent;
+		}
+		if ( channel.flags & AccelerationDirty )
+		{
+			channel.sentAcceleration = channel.acceleration;
+			channel.flags |= AccelerationSent;
+		}
+		channel.flags &= ~(TargetDirty | SpeedDirty | AccelerationDirty);
+	}
+	mNumCommandsSent += numCommands;
+	return true;
+}
+
+bool ShadowState::sendTarget( unsigned char channelNumber )
+{
+	if ( mUsePololuProtocol )
+		return mSerialInterface->setTargetPP( mDeviceNumber, channelNumber, mChannels[channelNumber].target );
+	return mSerialInterface->setTargetCP( channelNumber, mChannels[channelNumber].target );
+}
+
+bool ShadowState::sendTargets()
+{
+	if ( !mUseMultipleTargets )
+	{
+		for ( std::size_t i=0; i<mChannels.size(); ++i )
+		{
+			if ( (mChannels[i].flags & TargetDirty) && !sendTarget( static_cast<unsigned char>(i) ) )
+				return false;
+		}
+		return true;
+	}
+
+	// Group the dirty targets in runs of contiguous channels, a run of one channel uses the shorter Set Target
+	std::size_t i = 0;
+	while ( i<mChannels.size() )
+	{
+		if ( !(mChannels[i].flags & TargetDirty) )
+		{
+			++i;
+			continue;
+		}
+		
+		std::size_t firstChannel = i;
+		mRunTargets.clear();
+		while ( i<mChannels.size() && (mChannels[i].flags & TargetDirty) && mRunTargets.size()<Protocol::SetMultipleTargets::maxNumTargets )
+			mRunTargets.push_back( mChannels[i++].target );
+
+		bool ret = false;
+		unsigned char firstChannelNumber = static_cast<unsigned char>(firstChannel);
+		unsigned char numTargets = static_cast<unsigned char>(mRunTargets.size());
+		if ( numTargets==1 )
+			ret = sendTarget( firstChannelNumber );
+		else if ( mUsePololuProtocol )
+			ret = mSerialInterface->setMultipleTargetsPP( mDeviceNumber, firstChannelNumber, numTargets, &mRunTargets[0] );
+		else
+			ret = mSerialInterface->setMultipleTargetsCP( firstChannelNumber, numTargets, &mRunTargets[0] );
+		if ( !ret )
+			return false;
+	}
+	return true;
+}
+
+}
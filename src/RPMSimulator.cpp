@@ -0,0 +1,347 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RPMSimulator.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace RPM
+{
+
+Simulator::Simulator( unsigned char numChannels, unsigned char deviceNumber )
+	: mChannels(numChannels),
+	  mDeviceNumber(deviceNumber),
+	  mMiniSSCOffset(0),
+	  mMiniSSCNeutral(6000),
+	  mMiniSSCRange(1905),
+	  mErrors(0),
+	  mNumCommandsProcessed(0),
+	  mTimeRemainderInMicroseconds(0),
+	  mParserState(WaitingForCommand),
+	  mIsForThisDevice(true),
+	  mCommand(0),
+	  mData(),
+	  mNumDataBytesExpected(0)
+{
+	mData.reserve(2 + 2*256);
+}
+
+unsigned short Simulator::getTarget( unsigned char channelNumber ) const
+{
+	if ( channelNumber>=mChannels.size() )
+		return 0;
+	return mChannels[channelNumber].target;
+}
+
+unsigned short Simulator::getPosition( unsigned char channelNumber ) const
+{
+	if ( channelNumber>=mChannels.size() )
+		return 0;
+	return static_cast<unsigned short>( mChannels[channelNumber].position + 0.5f );
+}
+
+unsigned short Simulator::getSpeed( unsigned char channelNumber ) const
+{
+	if ( channelNumber>=mChannels.size() )
+		return 0;
+	return mChannels[channelNumber].speed;
+}
+
+unsigned char Simulator::getAcceleration( unsigned char channelNumber ) const
+{
+	if ( channelNumber>=mChannels.size() )
+		return 0;
+	return mChannels[channelNumber].acceleration;
+}
+
+bool Simulator::isMoving() const
+{
+	for ( std::size_t i=0; i<mChannels.size(); ++i )
+	{
+		const Channel& channel = mChannels[i];
+		if ( channel.target!=0 && getPosition( static_cast<unsigned char>(i) )!=channel.target )
+			return true;
+	}
+	return false;
+}
+
+// Return the number of data bytes following the command byte, or -1 for unknown commands.
+// For Set Multiple Targets, this is only the count and first channel, the targets come next.
+unsigned int Simulator::getNumDataBytes( unsigned char command ) const
+{
+	switch ( command )
+	{
+	case 0x84: return 3;	// Set Target
+	case 0x87: return 3;	// Set Speed
+	case 0x89: return 3;	// Set Acceleration
+	case 0x9F: return 2;	// Set Multiple Targets
+	case 0x90: return 1;	// Get Position
+	case 0x93: return 0;	// Get Moving State
+	case 0xA1: return 0;	// Get Errors
+	case 0xA2: return 0;	// Go Home
+	default: return static_cast<unsigned int>(-1);
+	}
+}
+
+void Simulator::processBytes( const unsigned char* data, unsigned int dataSizeInBytes, std::vector<unsigned char>& response )
+{
+	for ( unsigned int i=0; i<dataSizeInBytes; ++i )
+	{
+		unsigned char byte = data[i];
+
+		// Mini-SSC data bytes use all 8 bits, 0xFF always starts a new command though
+		if ( mParserState==WaitingForMiniSSCData && byte!=0xFF )
+		{
+			mData.push_back( byte );
+			if ( mData.size()==2 )
+			{
+				executeCommand( response );
+				mParserState = WaitingForCommand;
+			}
+			continue;
+		}
+
+		if ( byte & 0x80 )
+		{
+			// A command byte interrupting an incomplete command. A lone 0xAA is the baud rate 
+			// indication byte though.
+			if ( mParserState!=WaitingForCommand && mParserState!=WaitingForDeviceNumber )
+				mErrors |= SerialProtocolError;
+
+			mData.clear();
+			mIsForThisDevice = true;
+			if ( byte==0xAA )
+			{
+				mParserState = WaitingForDeviceNumber;
+			}
+			else if ( byte==0xFF )
+			{
+				mCommand = byte;
+				mParserState = WaitingForMiniSSCData;
+			}
+			else if ( getNumDataBytes(byte)==static_cast<unsigned int>(-1) )
+			{
+				mErrors |= SerialProtocolError;
+				mParserState = WaitingForCommand;
+			}
+			else
+			{
+				mCommand = byte;
+				mNumDataBytesExpected = getNumDataBytes(byte);
+				mParserState = WaitingForData;
+			}
+		}
+		else
+		{
+			switch ( mParserState )
+			{
+			case WaitingForCommand:
+				mErrors |= SerialProtocolError;
+				break;
+
+			case WaitingForDeviceNumber:
+				mIsForThisDevice = ( byte==mDeviceNumber );
+				mParserState = WaitingForPololuCommand;
+				break;
+
+			case WaitingForPololuCommand:
+				mCommand = byte | 0x80;
+				mNumDataBytesExpected = getNumDataBytes(mCommand);
+				if ( mNumDataBytesExpected==static_cast<unsigned int>(-1) )
+				{
+					if ( mIsForThisDevice )
+						mErrors |= SerialProtocolError;
+					mParserState = WaitingForCommand;
+				}
+				else
+				{
+					mParserState = WaitingForData;
+				}
+				break;
+
+			case WaitingForData:
+				mData.push_back( byte );
+				if ( mCommand==0x9F && mData.size()==2 )
+					mNumDataBytesExpected = 2 + 2*mData[0];
+				break;
+
+			default:
+				break;
+			}
+		}
+
+		if ( mParserState==WaitingForData && mData.size()==mNumDataBytesExpected )
+		{
+			if ( mIsForThisDevice )
+				executeCommand( response );
+			mData.clear();
+			mParserState = WaitingForCommand;
+		}
+	}
+}
+
+void Simulator::executeCommand( std::vector<unsigned char>& response )
+{
+	mNumCommandsProcessed++;
+	switch ( mCommand )
+	{
+	case 0x84:
+		setTarget( mData[0], static_cast<unsigned short>( mData[1] + (mData[2] << 7) ) );
+		break;
+
+	case 0x87:
+		if ( mData[0]<mChannels.size() )
+			mChannels[mData[0]].speed = static_cast<unsigned short>( mData[1] + (mData[2] << 7) );
+		break;
+	
+	case 0x89:
+		if ( mData[0]<mChannels.size() )
+			mChannels[mData[0]].acceleration = static_cast<unsigned char>( mData[1] + (mData[2] << 7) );
+		break;
+
+	case 0x9F:
+		for ( unsigned int i=0; i<mData[0]; ++i )
+			setTarget( static_cast<unsigned char>(mData[1]+i), static_cast<unsigned short>( mData[2+i*2] + (mData[3+i*2] << 7) ) );
+		break;
+
+	case 0x90:
+		{
+			unsigned short position = getPosition( mData[0] );
+			response.push_back( static_cast<unsigned char>(position & 0xFF) );
+			response.push_back( static_cast<unsigned char>(position >> 8) );
+		}
+		break;
+
+	case 0x93:
+		response.push_back( isMoving() ? 0x01 : 0x00 );
+		break;
+
+	case 0xA1:
+		response.push_back( static_cast<unsigned char>(mErrors & 0xFF) );
+		response.push_back( static_cast<unsigned char>(mErrors >> 8) );
+		mErrors = 0;
+		break;
+
+	case 0xA2:
+		// The home state of every channel is "off"
+		for ( std::size_t i=0; i<mChannels.size(); ++i )
+			mChannels[i].target = 0;
+		break;
+
+	case 0xFF:
+		{
+			int channelNumber = static_cast<int>(mData[0]) - mMiniSSCOffset;
+			if ( channelNumber<0 || channelNumber>=static_cast<int>(mChannels.size()) )
+				break;
+			if ( mData[1]>254 )
+			{
+				mErrors |= SerialProtocolError;
+				break;
+			}
+			float offset = (static_cast<float>(mData[1]) - 127.f) / 127.f * static_cast<float>(mMiniSSCRange);
+			setTarget( static_cast<unsigned char>(channelNumber), static_cast<unsigned short>( static_cast<float>(mMiniSSCNeutral) + offset + 0.5f ) );
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+void Simulator::setTarget( unsigned char channelNumber, unsigned short target )
+{
+	if ( channelNumber>=mChannels.size() )
+		return;
+
+	// An output that was off jumps straight to its target
+	Channel& channel = mChannels[channelNumber];
+	channel.target = target;
+	if ( channel.position==0.f )
+	{
+		channel.position = static_cast<float>(target);
+		channel.velocity = 0.f;
+	}
+}
+
+void Simulator::update( unsigned int elapsedTimeInMicroseconds )
+{
+	// The speed and acceleration units are based on a 10ms period
+	const unsigned int periodInMicroseconds = 10000;
+	mTimeRemainderInMicroseconds += elapsedTimeInMicroseconds;
+	while ( mTimeRemainderInMicroseconds>=periodInMicroseconds )
+	{
+		for ( std::size_t i=0; i<mChannels.size(); ++i )
+			stepChannel( mChannels[i] );
+		mTimeRemainderInMicroseconds -= periodInMicroseconds;
+	}
+}
+
+void Simulator::stepChannel( Channel& channel )
+{
+	if ( channel.target==0 )
+	{
+		channel.position = 0.f;
+		channel.velocity = 0.f;
+		return;
+	}
+
+	float target = static_cast<float>(channel.target);
+	float distance = std::fabs( target - channel.position );
+	if ( distance==0.f )
+	{
+		channel.velocity = 0.f;
+		return;
+	}
+
+	if ( channel.speed==0 && channel.acceleration==0 )
+	{
+		channel.position = target;
+		channel.velocity = 0.f;
+		return;
+	}
+
+	float maxVelocity = channel.speed==0 ? distance : static_cast<float>(channel.speed);
+	if ( channel.acceleration==0 )
+	{
+		channel.velocity = maxVelocity;
+	}
+	else
+	{
+		// The acceleration is in (0.25 microsecond)/(10ms)/(80ms). 
+		// Start braking when the stopping distance reaches the remaining distance.
+		float acceleration = static_cast<float>(channel.acceleration) / 8.f;
+		float stoppingDistance = channel.velocity * channel.velocity / (2.f * acceleration);
+		if ( stoppingDistance>=distance )
+			channel.velocity = std::max( channel.velocity - acceleration, acceleration );
+		else
+			channel.velocity = std::min( channel.velocity + acceleration, maxVelocity );
+	}
+
+	float step = std::min( channel.velocity, distance );
+	channel.position += ( target>channel.position ) ? step : -step;
+	if ( step==distance )
+		channel.velocity = 0.f;
+}
+
+}
@@ -0,0 +1,122 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RPMStatistics.h"
+
+#include "RPMProtocol.h"
+
+namespace RPM
+{
+
+static void copyCounters( const std::atomic<unsigned long long int>* counters, unsigned int numCounters, unsigned long long int* values )
+{
+	for ( unsigned int i=0; i<numCounters; ++i )
+		values[i] = counters[i].load( std::memory_order_relaxed );
+}
+
+static void clearCounters( std::atomic<unsigned long long int>* counters, unsigned int numCounters )
+{
+	for ( unsigned int i=0; i<numCounters; ++i )
+		counters[i].store( 0, std::memory_order_relaxed );
+}
+
+unsigned long long int Statistics::Snapshot::getTotalNumCommands() const
+{
+	unsigned long long int total = 0;
+	for ( unsigned int i=0; i<NumOpcodes; ++i )
+		total += numCommands[i];
+	return total;
+}
+
+unsigned long long int Statistics::Snapshot::getTotalNumFailures() const
+{
+	unsigned long long int total = 0;
+	for ( unsigned int i=0; i<NumErrorCodes; ++i )
+		total += numFailures[i];
+	return total;
+}
+
+unsigned long long int Statistics::Snapshot::getPercentileInUs( const unsigned long long int* histogram, double percentile )
+{
+	unsigned long long int total = 0;
+	for ( unsigned int i=0; i<NumLatencyBuckets; ++i )
+		total += histogram[i];
+	if ( total==0 )
+		return 0;
+
+	double threshold = percentile / 100.0 * static_cast<double>(total);
+	unsigned long long int count = 0;
+	for ( unsigned int i=0; i<NumLatencyBuckets; ++i )
+	{
+		count += histogram[i];
+		if ( static_cast<double>(count)>=threshold )
+			return 1ULL << i;
+	}
+	return 1ULL << (NumLatencyBuckets-1);
+}
+
+Statistics::Statistics()
+{
+	reset();
+}
+
+void Statistics::addFrame( const unsigned char* frame, unsigned int frameSizeInBytes )
+{
+	if ( frameSizeInBytes==0 )
+		return;
+	if ( frame[0]==Protocol::PololuStartByte )
+	{
+		if ( frameSizeInBytes>=Protocol::PololuProtocol::headerSize )
+			addCommand( frame[2] );
+	}
+	else if ( frame[0] & 0x80 )
+	{
+		addCommand( frame[0] );		// The Mini-SSC start byte included
+	}
+}
+
+void Statistics::getSnapshot( Snapshot& snapshot ) const
+{
+	copyCounters( mNumCommands, NumOpcodes, snapshot.numCommands );
+	snapshot.numWrites = mNumWrites.load( std::memory_order_relaxed );
+	snapshot.numReads = mNumReads.load( std::memory_order_relaxed );
+	snapshot.numBytesWritten = mNumBytesWritten.load( std::memory_order_relaxed );
+	snapshot.numBytesRead = mNumBytesRead.load( std::memory_order_relaxed );
+	copyCounters( mNumFailures, NumErrorCodes, snapshot.numFailures );
+	copyCounters( mWriteLatencyHistogram, NumLatencyBuckets, snapshot.writeLatencyHistogram );
+	copyCounters( mRoundTripHistogram, NumLatencyBuckets, snapshot.roundTripHistogram );
+}
+
+void Statistics::reset()
+{
+	clearCounters( mNumCommands, NumOpcodes );
+	mNumWrites.store( 0, std::memory_order_relaxed );
+	mNumReads.store( 0, std::memory_order_relaxed );
+	mNumBytesWritten.store( 0, std::memory_order_relaxed );
+	mNumBytesRead.store( 0, std::memory_order_relaxed );
+	clearCounters( mNumFailures, NumErrorCodes );
+	clearCounters( mWriteLatencyHistogram, NumLatencyBuckets );
+	clearCounters( mRoundTripHistogram, NumLatencyBuckets );
+}
+
+}
@@ -0,0 +1,114 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RPMTargetCoalescer.h"
+
+namespace RPM
+{
+
+TargetCoalescer::TargetCoalescer( SerialInterface* serialInterface, unsigned char numChannels, bool usePololuProtocol, unsigned char deviceNumber )
+	: mSerialInterface(serialInterface),
+	  mNumChannels( numChannels<MaxNumChannels ? numChannels : static_cast<unsigned char>(MaxNumChannels) ),
+	  mUsePololuProtocol(usePololuProtocol),
+	  mDeviceNumber(deviceNumber),
+	  mNumTargetsSet(0),
+	  mNumTargetsSent(0)
+{
+	for ( unsigned int i=0; i<MaxNumChannels; ++i )
+		mPendingTargets[i].store( 0, std::memory_order_relaxed );
+}
+
+bool TargetCoalescer::setTarget( unsigned char channelNumber, unsigned short target )
+{
+	if ( channelNumber>=mNumChannels )
+		return false;
+	if ( target<SerialInterface::getMinChannelValue() || target>SerialInterface::getMaxChannelValue() )
+		return false;
+	mPendingTargets[channelNumber].store( PendingFlag | target, std::memory_order_release );
+	mNumTargetsSet.fetch_add( 1, std::memory_order_relaxed );
+	return true;
+}
+
+bool TargetCoalescer::hasPendingTargets() const
+{
+	for ( unsigned char i=0; i<mNumChannels; ++i )
+		if ( mPendingTargets[i].load(std::memory_order_relaxed)!=0 )
+			return true;
+	return false;
+}
+
+void TargetCoalescer::clear()
+{
+	for ( unsigned char i=0; i<mNumChannels; ++i )
+		mPendingTargets[i].store( 0, std::memory_order_relaxed );
+}
+
+bool TargetCoalescer::flush()
+{
+	if ( !mSerialInterface )
+		return false;
+
+	// Take the pending targets, the ones set from now on go to the next flush
+	unsigned int targets[MaxNumChannels];
+	unsigned int numTargets = 0;
+	for ( unsigned char i=0; i<mNumChannels; ++i )
+	{
+		targets[i] = mPendingTargets[i].exchange( 0, std::memory_order_acquire );
+		if ( targets[i]!=0 )
+			numTargets++;
+	}
+	if ( numTargets==0 )
+		return true;
+
+	bool ret = true;
+	mSerialInterface->beginBatch();
+	for ( unsigned char i=0; i<mNumChannels; ++i )
+	{
+		if ( targets[i]==0 )
+			continue;
+		unsigned short target = static_cast<unsigned short>( targets[i] & ~PendingFlag );
+		bool sent = mUsePololuProtocol ? 
+					mSerialInterface->setTargetPP( mDeviceNumber, i, target ) :
+					mSerialInterface->setTargetCP( i, target );
+		if ( !sent )
+			ret = false;
+	}
+	if ( !mSerialInterface->endBatch() )
+		ret = false;
+
+	if ( !ret )
+	{
+		// Put the targets back, unless a newer one has been set meanwhile
+		for ( unsigned char i=0; i<mNumChannels; ++i )
+		{
+			unsigned int expected = 0;
+			if ( targets[i]!=0 )
+				mPendingTargets[i].compare_exchange_strong( expected, targets[i], std::memory_order_release, std::memory_order_relaxed );
+		}
+		return false;
+	}
+	mNumTargetsSent.fetch_add( numTargets, std::memory_order_relaxed );
+	return true;
+}
+
+}
@@ -0,0 +1,191 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RPMTelemetrySampler.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace RPM
+{
+
+TelemetrySampler::TelemetrySampler( SerialInterface* serialInterface, unsigned int periodInUs, unsigned int historySize )
+	: mSerialInterface(serialInterface),
+	  mSerialMutex(NULL),
+	  mChannelNumbers(),
+	  mQuantities(Positions | MovingState | Errors),
+	  mUsePololuProtocol(false),
+	  mDeviceNumber(12),
+	  mTimeoutInMs( (periodInUs + 999) / 1000 ),
+	  mControlLoop(periodInUs),
+	  mRing(historySize),
+	  mNumFailures(0),
+	  mThread()
+{
+}
+
+TelemetrySampler::~TelemetrySampler()
+{
+	stop();
+}
+
+bool TelemetrySampler::setChannels( const unsigned char* channelNumbers, unsigned int numChannels )
+{
+	if ( isRunning() || numChannels>MaxNumChannels || (numChannels>0 && !channelNumbers) )
+		return false;
+	mChannelNumbers.assign( channelNumbers, channelNumbers + numChannels );
+	return true;
+}
+
+bool TelemetrySampler::setQuantities( unsigned int quantities )
+{
+	if ( isRunning() || (quantities & ~(Positions | MovingState | Errors)) )
+		return false;
+	mQuantities = quantities;
+	return true;
+}
+
+bool TelemetrySampler::setProtocol( bool usePololuProtocol, unsigned char deviceNumber )
+{
+	if ( isRunning() )
+		return false;
+	mUsePololuProtocol = usePololuProtocol;
+	mDeviceNumber = deviceNumber;
+	return true;
+}
+
+bool TelemetrySampler::setTimeout( unsigned int timeoutInMs )
+{
+	if ( isRunning() )
+		return false;
+	mTimeoutInMs = timeoutInMs;
+	return true;
+}
+
+bool TelemetrySampler::setSerialMutex( std::mutex* serialMutex )
+{
+	if ( isRunning() )
+		return false;
+	mSerialMutex = serialMutex;
+	return true;
+}
+
+bool TelemetrySampler::start()
+{
+	if ( isRunning() || !mSerialInterface || mQuantities==0 )
+		return false;
+	mControlLoop.reset();
+	mThread = std::thread( &TelemetrySampler::run, this );
+	return true;
+}
+
+void TelemetrySampler::stop()
+{
+	if ( !isRunning() )
+		return;
+	mControlLoop.stop();
+	mThread.join();
+}
+
+unsigned int TelemetrySampler::getHistory( Sample* samples, unsigned int maxNumSamples ) const
+{
+	unsigned long long int numPushed = mRing.getNumPushed();
+	unsigned long long int numAvailable = numPushed<mRing.getCapacity() ? numPushed : mRing.getCapacity();
+	if ( numAvailable>maxNumSamples )
+		numAvailable = maxNumSamples;
+
+	// The oldest samples may be overwritten while copying, they're then left out
+	unsigned int numSamples = 0;
+	for ( unsigned long long int index=numPushed-numAvailable; index<numPushed; ++index )
+	{
+		if ( mRing.read( index, samples[numSamples] ) )
+			numSamples++;
+	}
+	return numSamples;
+}
+
+void TelemetrySampler::run()
+{
+	// The loop's own batch isn't used: the queries flush it anyway
+	mControlLoop.run( NULL, [this]( unsigned long long int ) -> bool
+		{
+			Sample newSample;
+			sample( newSample );
+			mRing.push( newSample );
+			return true;
+		} );
+}
+
+void TelemetrySampler::sample( Sample& sample )
+{
+	std::memset( &sample, 0, sizeof(sample) );
+	sample.index = mRing.getNumPushed();
+	sample.numChannels = static_cast<unsigned int>(mChannelNumbers.size());
+	if ( !mChannelNumbers.empty() )
+		std::memcpy( sample.channelNumbers, &mChannelNumbers[0], mChannelNumbers.size() );
+
+	long long int startTime = getTimeInMicroseconds();
+	{
+		std::unique_lock<std::mutex> lock;
+		if ( mSerialMutex )
+			lock = std::unique_lock<std::mutex>( *mSerialMutex );
+
+		if ( (mQuantities & Positions) && !mChannelNumbers.empty() )
+		{
+			bool ret = mUsePololuProtocol ? 
+				mSerialInterface->getPositionsPP( mDeviceNumber, &mChannelNumbers[0], sample.numChannels, sample.positions, mTimeoutInMs ) :
+				mSerialInterface->getPositionsCP( &mChannelNumbers[0], sample.numChannels, sample.positions, mTimeoutInMs );
+			if ( ret )
+				sample.validQuantities |= Positions;
+		}
+		if ( mQuantities & MovingState )
+		{
+			bool ret = mUsePololuProtocol ? 
+				mSerialInterface->getMovingStatePP( mDeviceNumber, sample.servosAreMoving, mTimeoutInMs ) :
+				mSerialInterface->getMovingStateCP( sample.servosAreMoving, mTimeoutInMs );
+			if ( ret )
+				sample.validQuantities |= MovingState;
+		}
+		if ( mQuantities & Errors )
+		{
+			bool ret = mUsePololuProtocol ? 
+				mSerialInterface->getErrorsPP( mDeviceNumber, sample.errors, mTimeoutInMs ) :
+				mSerialInterface->getErrorsCP( sample.errors, mTimeoutInMs );
+			if ( ret )
+				sample.validQuantities |= Errors;
+		}
+	}
+	sample.timestampInUs = getTimeInMicroseconds();
+	sample.roundTripInUs = static_cast<unsigned int>(sample.timestampInUs - startTime);
+
+	unsigned int wantedQuantities = mChannelNumbers.empty() ? (mQuantities & ~Positions) : mQuantities;
+	if ( sample.validQuantities!=wantedQuantities )
+		mNumFailures.fetch_add( 1, std::memory_order_relaxed );
+}
+
+long long int TelemetrySampler::getTimeInMicroseconds()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+}
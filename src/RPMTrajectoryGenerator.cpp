@@ -0,0 +1,184 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RPMTrajectoryGenerator.h"
+
+namespace RPM
+{
+
+TrajectoryGenerator::Channel::Channel()
+	: target(6000),
+	  numSamples(0),
+	  sampleIndex(0)
+{
+}
+
+TrajectoryGenerator::TrajectoryGenerator( unsigned char numChannels, unsigned int periodInUs, unsigned int maxDurationInMs )
+	: mPeriodInUs(periodInUs>0 ? periodInUs : 1),
+	  mMaxNumSamples(0),
+	  mChannels(numChannels),
+	  mSamples(),
+	  mMoved(numChannels, false)
+{
+	mMaxNumSamples = getNumSamples( maxDurationInMs );
+	mSamples.resize( static_cast<std::size_t>(numChannels) * mMaxNumSamples );
+}
+
+unsigned int TrajectoryGenerator::getNumSamples( unsigned int durationInMs ) const
+{
+	// At least one sample, the target itself
+	unsigned long long int numSamples = ( static_cast<unsigned long long int>(durationInMs) * 1000 + mPeriodInUs - 1 ) / mPeriodInUs;
+	return numSamples>0 ? static_cast<unsigned int>(numSamples) : 1;
+}
+
+// Return the fraction of the move done at the normalized time t (between 0 and 1)
+double TrajectoryGenerator::getProfileValue( Profile profile, double t )
+{
+	switch ( profile )
+	{
+	case Linear:
+		return t;
+	case Cubic:
+		return t*t*(3 - 2*t);
+	case MinimumJerk:
+		return t*t*t*(10 + t*(-15 + 6*t));
+	}
+	return t;
+}
+
+bool TrajectoryGenerator::setTarget( unsigned char channelNumber, unsigned short target )
+{
+	if ( channelNumber>=mChannels.size() )
+		return false;
+	if ( target<SerialInterface::getMinChannelValue() || target>SerialInterface::getMaxChannelValue() )
+		return false;
+	stop( channelNumber );
+	mChannels[channelNumber].target = target;
+	return true;
+}
+
+bool TrajectoryGenerator::planMove( unsigned char channelNumber, unsigned short target, unsigned int numSamples, Profile profile )
+{
+	Channel& channel = mChannels[channelNumber];
+	unsigned short* samples = &mSamples[ static_cast<std::size_t>(channelNumber) * mMaxNumSamples ];
+	double startTarget = channel.target;
+	double distance = static_cast<double>(target) - startTarget;
+	for ( unsigned int i=0; i<numSamples-1; ++i )
+	{
+		double t = static_cast<double>(i+1) / numSamples;
+		samples[i] = static_cast<unsigned short>( startTarget + distance * getProfileValue( profile, t ) + 0.5 );
+	}
+	samples[numSamples-1] = target;
+	channel.numSamples = numSamples;
+	channel.sampleIndex = 0;
+	return true;
+}
+
+bool TrajectoryGenerator::moveTo( unsigned char channelNumber, unsigned short target, unsigned int durationInMs, Profile profile )
+{
+	if ( channelNumber>=mChannels.size() )
+		return false;
+	if ( target<SerialInterface::getMinChannelValue() || target>SerialInterface::getMaxChannelValue() )
+		return false;
+	unsigned int numSamples = getNumSamples( durationInMs );
+	if ( numSamples>mMaxNumSamples )
+		return false;
+	return planMove( channelNumber, target, numSamples, profile );
+}
+
+bool TrajectoryGenerator::moveTo( const unsigned short* targets, unsigned int durationInMs, Profile profile )
+{
+	if ( !targets )
+		return false;
+	for ( std::size_t i=0; i<mChannels.size(); ++i )
+	{
+		if ( targets[i]<SerialInterface::getMinChannelValue() || targets[i]>SerialInterface::getMaxChannelValue() )
+			return false;
+	}
+	unsigned int numSamples = getNumSamples( durationInMs );
+	if ( numSamples>mMaxNumSamples )
+		return false;
+	
+	for ( std::size_t i=0; i<mChannels.size(); ++i )
+		planMove( static_cast<unsigned char>(i), targets[i], numSamples, profile );
+	return true;
+}
+
+void TrajectoryGenerator::stop( unsigned char channelNumber )
+{
+	if ( channelNumber>=mChannels.size() )
+		return;
+	mChannels[channelNumber].numSamples = 0;
+	mChannels[channelNumber].sampleIndex = 0;
+}
+
+void TrajectoryGenerator::stop()
+{
+	for ( std::size_t i=0; i<mChannels.size(); ++i )
+		stop( static_cast<unsigned char>(i) );
+}
+
+bool TrajectoryGenerator::isMoving( unsigned char channelNumber ) const
+{
+	if ( channelNumber>=mChannels.size() )
+		return false;
+	return mChannels[channelNumber].sampleIndex<mChannels[channelNumber].numSamples;
+}
+
+bool TrajectoryGenerator::isMoving() const
+{
+	for ( std::size_t i=0; i<mChannels.size(); ++i )
+	{
+		if ( mChannels[i].sampleIndex<mChannels[i].numSamples )
+			return true;
+	}
+	return false;
+}
+
+void TrajectoryGenerator::step()
+{
+	for ( std::size_t i=0; i<mChannels.size(); ++i )
+	{
+		Channel& channel = mChannels[i];
+		mMoved[i] = false;
+		if ( channel.sampleIndex>=channel.numSamples )
+			continue;
+		channel.target = mSamples[ i * mMaxNumSamples + channel.sampleIndex ];
+		channel.sampleIndex++;
+		mMoved[i] = true;
+	}
+}
+
+bool TrajectoryGenerator::step( ShadowState& shadowState )
+{
+	step();
+	unsigned char numChannels = shadowState.getNumChannels()<getNumChannels() ? shadowState.getNumChannels() : getNumChannels();
+	for ( unsigned char i=0; i<numChannels; ++i )
+	{
+		if ( mMoved[i] )
+			shadowState.setTarget( i, mChannels[i].target );
+	}
+	return shadowState.flush();
+}
+
+}
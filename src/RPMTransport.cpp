@@ -21,34 +21,18 @@
    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
    SOFTWARE.
 */
-#pragma once
-
-#include "RPMSerialInterface.h"
+#include "RPMTransport.h"
 
 namespace RPM
 {
 
-class SerialInterfacePOSIX : public SerialInterface
+Transport::Transport()
+	: mError()
 {
-public:
-	// Creates a POSIX SerialInterface. 
-	// The syntax of the port name depends on the platform. For example: 
-	// - on Windows: "\\\\.\\USBSER000", "\\\\.\\COM6", etc... 
-	// - on Linux: "/dev/ttyACM0"
-	// - on Mac OS: "/dev/cu.usbmodem00034567"
-	SerialInterfacePOSIX( const std::string& portName, std::string* errorMessage=NULL );
-
-	virtual ~SerialInterfacePOSIX();
-
-	virtual bool isOpen() const;
+}
 
-private:
-	int openPort( const std::string& portName, std::string* errorMessage=NULL );
-	
-	virtual bool writeBytes( const unsigned char* data, unsigned int dataSizeInBytes );
-	virtual bool readBytes( unsigned char* data, unsigned int dataSizeInBytes );
-
-	int	mFileDescriptor;
-};
+Transport::~Transport()
+{
+}
 
-}
\ No newline at end of file
+}
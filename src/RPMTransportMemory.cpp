@@ -0,0 +1,116 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RPMTransportMemory.h"
+
+#include <string.h>
+
+#include "RPMSimulator.h"
+
+namespace RPM
+{
+
+TransportMemory::TransportMemory( Simulator* simulator )
+	: Transport(),
+	  mSimulator(simulator),
+	  mKeepWrittenBytes(false),
+	  mWrittenBytes(),
+	  mResponseBytes(),
+	  mResponseReadPosition(0),
+	  mNumWrites(0),
+	  mNumBytesWritten(0),
+	  mNumReads(0),
+	  mNumBytesRead(0)
+{
+	mWrittenBytes.reserve(4096);
+	mResponseBytes.reserve(4096);
+}
+
+TransportMemory::~TransportMemory()
+{
+}
+
+bool TransportMemory::writeBytes( const unsigned char* data, unsigned int numBytesToWrite )
+{
+	mNumWrites++;
+	mNumBytesWritten += numBytesToWrite;
+	if ( mKeepWrittenBytes )
+		mWrittenBytes.insert( mWrittenBytes.end(), data, data+numBytesToWrite );
+	if ( mSimulator )
+	{
+		// Reclaim the space of the responses already read before appending new ones
+		if ( mResponseReadPosition==mResponseBytes.size() )
+		{
+			mResponseBytes.clear();
+			mResponseReadPosition = 0;
+		}
+		mSimulator->processBytes( data, numBytesToWrite, mResponseBytes );
+	}
+	return true;
+}
+
+// There's nothing to wait for in memory: if the bytes aren't there, they'll never be
+bool TransportMemory::readBytes( unsigned char* data, unsigned int numBytesToRead, unsigned int timeoutInMs )
+{
+	clearError();
+	if ( numBytesToRead==0 )
+		return true;
+
+	unsigned int numBytesAvailable = getNumResponseBytesAvailable();
+	if ( numBytesAvailable<numBytesToRead )
+	{
+		setError( TimeoutError, 0, numBytesAvailable, numBytesToRead, timeoutInMs );
+		mResponseBytes.clear();
+		mResponseReadPosition = 0;
+		return false;
+	}
+
+	memcpy( data, &mResponseBytes[mResponseReadPosition], numBytesToRead );
+	mResponseReadPosition += numBytesToRead;
+	if ( mResponseReadPosition==mResponseBytes.size() )
+	{
+		mResponseBytes.clear();
+		mResponseReadPosition = 0;
+	}
+	mNumReads++;
+	mNumBytesRead += numBytesToRead;
+	return true;
+}
+
+void TransportMemory::addResponseBytes( const unsigned char* data, unsigned int dataSizeInBytes )
+{
+	mResponseBytes.insert( mResponseBytes.end(), data, data+dataSizeInBytes );
+}
+
+unsigned int TransportMemory::getNumResponseBytesAvailable() const
+{
+	return static_cast<unsigned int>( mResponseBytes.size() - mResponseReadPosition );
+}
+
+void TransportMemory::clearResponseBytes()
+{
+	mResponseBytes.clear();
+	mResponseReadPosition = 0;
+}
+
+}
@@ -0,0 +1,278 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RPMTransportPOSIX.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sstream>
+#include <string.h>
+
+#ifdef _WIN32
+#define O_NOCTTY 0
+#else
+#include <termios.h>
+#include <poll.h>
+#include <time.h>
+#endif
+
+#include <errno.h>  
+
+namespace RPM
+{
+
+#ifndef _WIN32
+// Return the termios constant of a baud rate, if it has one
+static bool getStandardBaudRate( unsigned int baudRate, speed_t& speed )
+{
+	switch ( baudRate )
+	{
+	case 300:		speed = B300; return true;
+	case 600:		speed = B600; return true;
+	case 1200:		speed = B1200; return true;
+	case 2400:		speed = B2400; return true;
+	case 4800:		speed = B4800; return true;
+	case 9600:		speed = B9600; return true;
+	case 19200:		speed = B19200; return true;
+	case 38400:		speed = B38400; return true;
+	case 57600:		speed = B57600; return true;
+	case 115200:	speed = B115200; return true;
+#ifdef B230400
+	case 230400:	speed = B230400; return true;
+#endif
+	default:		return false;
+	}
+}
+
+static unsigned long long int getTimeInMicroseconds()
+{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return static_cast<unsigned long long int>(now.tv_sec) * 1000000ULL + now.tv_nsec / 1000;
+}
+#endif
+
+TransportPOSIX::TransportPOSIX( const std::string& portName, unsigned int baudRate, std::string* errorMessage )
+	:	Transport(),
+		mFileDescriptor(-1),
+		mDiscardInputBeforeWrite(false)
+{
+	mFileDescriptor = openPort( portName, baudRate, errorMessage );
+}
+
+TransportPOSIX::~TransportPOSIX()
+{
+	if ( isOpen() )
+	{
+		close( mFileDescriptor );
+	}
+	mFileDescriptor = -1;
+}
+
+bool TransportPOSIX::isOpen() const
+{
+	return mFileDescriptor!=-1;
+}
+
+int TransportPOSIX::openPort( const std::string& portName, unsigned int baudRate, std::string* errorMessage )
+{
+	if ( baudRate!=0 && (baudRate<getMinBaudRate() || baudRate>getMaxBaudRate()) )
+	{
+		if ( errorMessage )
+		{
+			std::stringstream stream;
+			stream << "Failed to open serial port \"" << portName << "\". ";
+			stream << "Unsupported baud rate " << baudRate << ", it must be between " << getMinBaudRate() << " and " << getMaxBaudRate();
+			*errorMessage = stream.str();
+		}
+		return -1;
+	}
+
+	int fd = open( portName.c_str(), O_RDWR | O_NOCTTY );
+	if (fd == -1)
+	{
+		if ( errorMessage )
+		{
+			std::stringstream stream;
+			stream << "Failed to open serial port \"" << portName << "\". ";
+			stream << strerror(errno);
+			*errorMessage = stream.str();
+		}
+		return -1;
+	}
+
+#ifndef _WIN32
+	struct termios options;
+	if ( tcgetattr(fd, &options)!=0 )
+	{
+		if ( errorMessage )
+		{
+			std::stringstream stream;
+			stream << "Failed to open serial port \"" << portName << "\". ";
+			stream << "Unable to get terminal attributes. " << strerror(errno);
+			*errorMessage = stream.str();
+		}
+		close(fd);
+		return -1;
+	}
+
+	// Raw mode: the bytes go through untouched in both directions (no echo, no signal characters, 
+	// no line editing, no CR/LF translation, no software or hardware flow control), 8 data bits, 
+	// no parity and 1 stop bit. A read returns as soon as one byte is available.
+	options.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF | IXANY);
+	options.c_oflag &= ~OPOST;
+	options.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+	options.c_cflag &= ~(CSIZE | PARENB | CSTOPB);
+#ifdef CRTSCTS
+	options.c_cflag &= ~CRTSCTS;
+#endif
+	options.c_cflag |= CS8 | CLOCAL | CREAD;
+	options.c_cc[VMIN] = 1;
+	options.c_cc[VTIME] = 0;
+
+	// The baud rate only matters on the TTL serial port, the USB virtual port ignores it
+	speed_t speed = 0;
+	bool isStandardBaudRate = getStandardBaudRate( baudRate, speed );
+	if ( baudRate!=0 && isStandardBaudRate )
+	{
+		cfsetispeed( &options, speed );
+		cfsetospeed( &options, speed );
+	}
+
+	bool success = ( tcsetattr(fd, TCSANOW, &options)==0 );
+	if ( success && baudRate!=0 && !isStandardBaudRate )
+		success = setCustomBaudRate( fd, baudRate );
+	if ( !success )
+	{
+		if ( errorMessage )
+		{
+			std::stringstream stream;
+			stream << "Failed to open serial port \"" << portName << "\". ";
+			stream << "Unable to set terminal attributes (baud rate " << baudRate << "). " << strerror(errno);
+			*errorMessage = stream.str();
+		}
+		close(fd);
+		return -1;
+	}
+
+	// Discard any bytes received from the device earlier
+	tcflush( fd, TCIOFLUSH );
+#endif
+
+	return fd;
+}
+
+bool TransportPOSIX::writeBytes( const unsigned char* data, unsigned int numBytesToWrite )
+{
+	if ( !isOpen() )
+	{
+		setError( PortClosedError );
+		return false;
+	}
+
+#ifndef _WIN32
+	if ( mDiscardInputBeforeWrite )
+	{
+		tcflush( mFileDescriptor, TCIFLUSH );
+		mDiscardInputBeforeWrite = false;
+	}
+#endif
+
+	// See http://linux.die.net/man/2/write
+	ssize_t ret = write( mFileDescriptor, data, numBytesToWrite );
+	if ( ret==-1 )
+	{
+		setError( WriteError, errno );
+		return false;
+	}
+	else if ( ret!=numBytesToWrite )
+	{
+		setError( ShortWriteError, 0, static_cast<unsigned int>(ret), numBytesToWrite );
+		return false;
+	}
+
+	return true;
+}
+
+bool TransportPOSIX::readBytes( unsigned char* data, unsigned int numBytesToRead, unsigned int timeoutInMs )
+{
+	clearError();
+	if ( !isOpen() )
+	{
+		setError( PortClosedError );
+		return false;
+	}
+
+	// See http://linux.die.net/man/2/read
+	// We wait for the bytes with poll() so a lost response can't block the caller forever. 
+	// Large responses (for example several positions read at once) can arrive in more than one 
+	// chunk, so we loop until all the bytes are there or the deadline has passed.
+#ifndef _WIN32
+	unsigned long long int deadline = getTimeInMicroseconds() + timeoutInMs * 1000ULL;
+#endif
+	unsigned int numBytesRead = 0;
+	while ( numBytesRead<numBytesToRead )
+	{
+#ifndef _WIN32
+		unsigned long long int now = getTimeInMicroseconds();
+		int remainingTimeInMs = now<deadline ? static_cast<int>( (deadline - now + 999) / 1000 ) : 0;
+		struct pollfd pollDescriptor;
+		pollDescriptor.fd = mFileDescriptor;
+		pollDescriptor.events = POLLIN;
+		pollDescriptor.revents = 0;
+		int pollRet = poll( &pollDescriptor, 1, remainingTimeInMs );
+		if ( pollRet==-1 )
+		{
+			if ( errno==EINTR )
+				continue;
+			setError( DeviceError, errno );
+			return false;
+		}
+		else if ( pollRet==0 )
+		{
+			setError( TimeoutError, 0, numBytesRead, numBytesToRead, timeoutInMs );
+
+			// The response might still arrive later, it must not be taken for the response of the next request 
+			mDiscardInputBeforeWrite = true;
+			return false;
+		}
+#endif
+		ssize_t ret = read( mFileDescriptor, data+numBytesRead, numBytesToRead-numBytesRead );
+		if ( ret==-1 )
+		{
+			if ( errno==EINTR || errno==EAGAIN )
+				continue;
+			setError( ReadError, errno, numBytesRead, numBytesToRead );
+			return false;
+		}
+		else if ( ret==0 )
+		{
+			setError( ShortReadError, 0, numBytesRead, numBytesToRead );
+			return false;
+		}
+		numBytesRead += static_cast<unsigned int>(ret);
+	}
+	return true;
+}
+
+};
@@ -0,0 +1,61 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RPMTransportPOSIX.h"
+
+// Baud rates without a Bxxx constant need platform-specific calls. On Linux, the termios2 
+// structure can't be used in the same translation unit as <termios.h>, hence this file.
+#if defined(__linux__)
+	#include <sys/ioctl.h>
+	#include <asm/termbits.h>
+#elif defined(__APPLE__)
+	#include <sys/ioctl.h>
+	#include <termios.h>
+	#include <IOKit/serial/ioss.h>
+#endif
+
+namespace RPM
+{
+
+bool TransportPOSIX::setCustomBaudRate( int fileDescriptor, unsigned int baudRate )
+{
+#if defined(__linux__)
+	struct termios2 options;
+	if ( ioctl( fileDescriptor, TCGETS2, &options )!=0 )
+		return false;
+	options.c_cflag &= ~CBAUD;
+	options.c_cflag |= BOTHER;
+	options.c_ispeed = baudRate;
+	options.c_ospeed = baudRate;
+	return ioctl( fileDescriptor, TCSETS2, &options )==0;
+#elif defined(__APPLE__)
+	speed_t speed = baudRate;
+	return ioctl( fileDescriptor, IOSSIOSPEED, &speed )==0;
+#else
+	(void)fileDescriptor;
+	(void)baudRate;
+	return false;
+#endif
+}
+
+}
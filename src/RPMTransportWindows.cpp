@@ -21,39 +21,38 @@
    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
    SOFTWARE.
 */
-#include "RPMSerialInterfaceWindows.h"
+#include "RPMTransportWindows.h"
 
 #include <sstream>
 
 namespace RPM
 {
 
-SerialInterfaceWindows::SerialInterfaceWindows( const std::string& portName, unsigned int baudRate, std::string* errorMessage )
-	:	SerialInterface(),
-		mPortHandle(NULL)
+TransportWindows::TransportWindows( const std::string& portName, unsigned int baudRate, std::string* errorMessage )
+	:	Transport(),
+		mPortHandle(NULL),
+		mReadTimeoutInMs(1000),
+		mDiscardInputBeforeWrite(false)
 {
 	mPortHandle = openPort( portName, baudRate, errorMessage );
 }
 
-SerialInterfaceWindows::~SerialInterfaceWindows()
+TransportWindows::~TransportWindows()
 {
 	if ( isOpen() )
 	{
-		// Before destroying the interface, we "go home"
-		goHomeCP();
-		
 		CloseHandle( mPortHandle );
 	}
 	mPortHandle = NULL;
 }
 
-bool SerialInterfaceWindows::isOpen() const 
+bool TransportWindows::isOpen() const 
 { 
 	return mPortHandle!=INVALID_HANDLE_VALUE; 
 }
 
 //  Open the port at given baud rate. Return the port handle when successful, otherwise return INVALID_HANDLE_VALUE
-HANDLE SerialInterfaceWindows::openPort( const std::string& portName, unsigned int baudRate, std::string* errorMessage )
+HANDLE TransportWindows::openPort( const std::string& portName, unsigned int baudRate, std::string* errorMessage )
 {
 	// Open the serial port
 	HANDLE port = CreateFileA(portName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
@@ -95,8 +94,8 @@ HANDLE SerialInterfaceWindows::openPort( const std::string& portName, unsigned i
 		return INVALID_HANDLE_VALUE;
 	}
 
-	timeouts.ReadIntervalTimeout = 1000;
-	timeouts.ReadTotalTimeoutConstant = 1000;
+	timeouts.ReadIntervalTimeout = 0;
+	timeouts.ReadTotalTimeoutConstant = 1000;		// Changed on each read if needed, see readBytes
 	timeouts.ReadTotalTimeoutMultiplier = 0;
 	timeouts.WriteTotalTimeoutConstant = 1000;
 	timeouts.WriteTotalTimeoutMultiplier = 0;
@@ -163,51 +162,80 @@ HANDLE SerialInterfaceWindows::openPort( const std::string& portName, unsigned i
 	return port;
 }
 
-bool SerialInterfaceWindows::writeBytes( const unsigned char* data, unsigned int numBytesToWrite )
+bool TransportWindows::writeBytes( const unsigned char* data, unsigned int numBytesToWrite )
 {
 	if ( !isOpen() )
+	{
+		setError( PortClosedError );
 		return false;
+	}
+
+	if ( mDiscardInputBeforeWrite )
+	{
+		PurgeComm( mPortHandle, PURGE_RXCLEAR );
+		mDiscardInputBeforeWrite = false;
+	}
 
 	DWORD bytesTransferred = 0;
 	BOOL success = WriteFile( mPortHandle, data, numBytesToWrite, &bytesTransferred, NULL );
 	if ( !success )
 	{
-		std::stringstream stream;
-		stream << "Unable to write bytes to serial port. " << std::hex << "Error code 0x" << GetLastError();
-		setErrorMessage( stream.str() );
+		setError( WriteError, static_cast<int>(GetLastError()) );
 		return false;
 	}
 
 	if ( numBytesToWrite!=bytesTransferred )
 	{
-		std::stringstream stream;
-		stream << "Unable to write bytes to serial port. Wrote only " << bytesTransferred << " out of " << numBytesToWrite;
-		setErrorMessage( stream.str() );
+		setError( ShortWriteError, 0, bytesTransferred, numBytesToWrite );
 		return false;
 	}
 	return true;
 }
 
-bool SerialInterfaceWindows::readBytes( unsigned char* data, unsigned int numBytesToRead )
+bool TransportWindows::readBytes( unsigned char* data, unsigned int numBytesToRead, unsigned int timeoutInMs )
 {
+	clearError();
 	if ( !isOpen() )
+	{
+		setError( PortClosedError );
 		return false;
+	}
+
+	// The read timeout is a property of the port, only change it when needed
+	if ( timeoutInMs!=mReadTimeoutInMs )
+	{
+		COMMTIMEOUTS timeouts;
+		BOOL success = GetCommTimeouts( mPortHandle, &timeouts );
+		if ( success )
+		{
+			timeouts.ReadIntervalTimeout = 0;
+			timeouts.ReadTotalTimeoutConstant = timeoutInMs;
+			timeouts.ReadTotalTimeoutMultiplier = 0;
+			success = SetCommTimeouts( mPortHandle, &timeouts );
+		}
+		if ( !success )
+		{
+			setError( DeviceError, static_cast<int>(GetLastError()) );
+			return false;
+		}
+		mReadTimeoutInMs = timeoutInMs;
+	}
 
 	DWORD bytesTransferred = 0;
 	BOOL success = ReadFile( mPortHandle, data, numBytesToRead, &bytesTransferred, NULL );
 	if ( !success )
 	{
-		std::stringstream stream;
-		stream << "Unable to read bytes from serial port. " << std::hex << "Error code 0x" << GetLastError();
-		setErrorMessage( stream.str() );
+		setError( ReadError, static_cast<int>(GetLastError()) );
 		return false;
 	}
 
+	// ReadFile returns what it got when the timeout expires
 	if ( numBytesToRead!=bytesTransferred )
 	{
-		std::stringstream stream;
-		stream << "Unable to read bytes from serial port. Read only " << bytesTransferred << " out of " << numBytesToRead;
-		setErrorMessage( stream.str() );
+		setError( TimeoutError, 0, bytesTransferred, numBytesToRead, timeoutInMs );
+
+		// The response might still arrive later, it must not be taken for the response of the next request 
+		mDiscardInputBeforeWrite = true;
 		return false;
 	}
 	return true;